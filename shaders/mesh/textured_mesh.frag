@@ -1,12 +1,20 @@
 #version 450
 
 layout (location = 0) in vec2 uv;
+layout (location = 1) flat in uint tex_id;
 
 layout (set = 0, binding = 0) uniform sampler2D texture_;
 
 layout (location = 0) out vec4 frag_color;
 
 void main() {
-    frag_color = texture(texture_, uv);
-}
+    const ivec2 atlas_tiles = ivec2(16, 16);
+    const vec2 tile_size = 1.0 / vec2(atlas_tiles);
 
+    vec2 tile_pos = vec2(int(tex_id) % atlas_tiles.x, int(tex_id) / atlas_tiles.x);
+    vec2 atlas_uv = (tile_pos + fract(uv)) * tile_size;
+
+    // The wrap makes the coordinates jump at block edges, take the derivatives from the unwrapped ones so the mip
+    // level doesn't jump with them.
+    frag_color = textureGrad(texture_, atlas_uv, dFdx(uv) * tile_size, dFdy(uv) * tile_size);
+}
\ No newline at end of file
@@ -2,31 +2,17 @@
 #extension GL_EXT_buffer_reference : require
 
 layout (location = 0) out vec2 out_uv;
+layout (location = 1) flat out uint out_tex_id;
 
 layout (buffer_reference, std430) readonly buffer Buffer {
-    uint vertices[];
+    uint faces[];
 };
 
 layout (push_constant) uniform constants {
     mat4 view_proj_model;
-    Buffer vertex_buffer;
+    Buffer face_buffer;
 } push_constants;
 
- const vec3 face_corner_offsets[6][4] = {
-     // Front (+Z)
-     { vec3(1, 0, 1), vec3(0, 0, 1), vec3(0, 1, 1), vec3(1, 1, 1) },
-     // Back (-Z)
-     { vec3(0, 0, 0), vec3(1, 0, 0), vec3(1, 1, 0), vec3(0, 1, 0) },
-     // Left (-X)
-     { vec3(0, 0, 1), vec3(0, 0, 0), vec3(0, 1, 0), vec3(0, 1, 1) },
-     // Right (+X)
-     { vec3(1, 0, 0), vec3(1, 0, 1), vec3(1, 1, 1), vec3(1, 1, 0) },
-     // Top (+Y)
-     { vec3(0, 1, 0), vec3(1, 1, 0), vec3(1, 1, 1), vec3(0, 1, 1) },
-     // Bottom (-Y)
-     { vec3(0, 0, 1), vec3(1, 0, 1), vec3(1, 0, 0), vec3(0, 0, 0) }
- };
-
 const vec3 normals[6] = {
     vec3( 0,  0,  1),  // Front (Red)
     vec3( 0,  0, -1),  // Back (Green)
@@ -36,38 +22,66 @@ const vec3 normals[6] = {
     vec3( 0, -1,  0)   // Bottom (Cyan)
 };
 
-const vec2 corner_uvs[4] = {
-    vec2(0, 1),
-    vec2(1, 1),
-    vec2(1, 0),
-    vec2(0, 0)
+// Corners of a unit quad for each face, four per face in winding order.
+const vec3 face_corners[24] = {
+    vec3(1, 0, 1), vec3(0, 0, 1), vec3(0, 1, 1), vec3(1, 1, 1), // Front (+Z)
+    vec3(0, 0, 0), vec3(1, 0, 0), vec3(1, 1, 0), vec3(0, 1, 0), // Back (-Z)
+    vec3(0, 0, 1), vec3(0, 0, 0), vec3(0, 1, 0), vec3(0, 1, 1), // Left (-X)
+    vec3(1, 0, 0), vec3(1, 0, 1), vec3(1, 1, 1), vec3(1, 1, 0), // Right (+X)
+    vec3(0, 1, 0), vec3(1, 1, 0), vec3(1, 1, 1), vec3(0, 1, 1), // Top (+Y)
+    vec3(0, 0, 1), vec3(1, 0, 1), vec3(1, 0, 0), vec3(0, 0, 0)  // Bottom (-Y)
 };
 
-vec2 get_texture_coords(uint tex_index, vec2 corner_uv) {
-    const ivec2 atlas_tiles = ivec2(16, 16);
-    const vec2 tile_size = 1.0 / vec2(atlas_tiles);
-    
-    ivec2 tile_pos = ivec2(
-        int(tex_index) % atlas_tiles.x,
-        int(tex_index) / atlas_tiles.x
-    );
-    
-    return vec2(tile_pos) * tile_size + corner_uv * tile_size;
+// The two triangles of a quad, six vertices per face.
+const uint quad_corners[6] = {0u, 1u, 2u, 0u, 2u, 3u};
+
+// Axis a face looks along, 0 = X, 1 = Y, 2 = Z.
+const uint face_axes[6] = {2u, 2u, 0u, 0u, 1u, 1u};
+
+// Atlas tile of each block type's face, blocks without a texture of their own show stone.
+uint get_tile(uint block, uint face) {
+    switch (block) {
+    case 1u: return face == 4u ? 18u : face == 5u ? 16u : 17u; // Dirt
+    case 2u: return 2u;                                        // Lava
+    case 3u: return 3u;                                        // Water
+    case 5u: return 0u;                                        // Wood
+    default: return 1u;                                        // Stone
+    }
+}
+
+// Texture coordinates in blocks, picked so every block of a (possibly merged) quad shows its tile the same way up
+// as a single block face would. The fragment shader wraps them into the tile.
+vec2 get_block_uv(uint face, vec3 pos) {
+    switch (face) {
+    case 0u: return vec2(-pos.x, -pos.y); // Front
+    case 1u: return vec2( pos.x, -pos.y); // Back
+    case 2u: return vec2(-pos.z, -pos.y); // Left
+    case 3u: return vec2( pos.z, -pos.y); // Right
+    case 4u: return vec2( pos.x, -pos.z); // Top
+    default: return vec2(pos.x, pos.z);   // Bottom
+    }
 }
 
 void main() {
-    const uint v = push_constants.vertex_buffer.vertices[gl_VertexIndex];
+    const uint f = push_constants.face_buffer.faces[gl_VertexIndex / 6];
+
+    const uint x      = f         & 0x1F;        // 5 bits
+    const uint y      = (f >> 5)  & 0x3F;        // 6 bits
+    const uint z      = (f >> 11) & 0x1F;        // 5 bits
+    const uint face   = (f >> 16) & 0x07;        // 3 bits
+    const uint width  = ((f >> 19) & 0x1F) + 1;  // 5 bits
+    const uint height = ((f >> 24) & 0x1F) + 1;  // 5 bits
+    const uint block  = (f >> 29) & 0x07;        // 3 bits
+
+    // The quad spans `width` blocks along its first plane axis and `height` along the second, see FaceMasks.
+    const uint axis = face_axes[face];
+    vec3 size = vec3(1.0);
+    size[axis == 0u ? 2 : 0] = float(width);
+    size[axis == 1u ? 2 : 1] = float(height);
 
-    const uint x      = v         & 0x1F;  // 5 bits
-    const uint y      = (v >> 5)  & 0x3F;  // 6 bits
-    const uint z      = (v >> 11) & 0x1F;  // 5 bits
-    const uint face   = (v >> 16) & 0x07;  // 3 bits
-    const uint corner = (v >> 19) & 0x03;  // 2 bits
-    const uint tex_id = (v >> 21) & 0x1FF; // 9 bits
-    const uint ao     = (v >> 30) & 0x03;  // 2 bits
-    
-    out_uv = get_texture_coords(tex_id, corner_uvs[corner]);
+    const vec3 pos = vec3(x, y, z) + face_corners[face * 4 + quad_corners[gl_VertexIndex % 6]] * size;
+    out_uv = get_block_uv(face, pos);
+    out_tex_id = get_tile(block, face);
 
-    const vec3 offset = face_corner_offsets[face][corner];
-    gl_Position = push_constants.view_proj_model * vec4(vec3(x, y, z) + offset, 1.0);
+    gl_Position = push_constants.view_proj_model * vec4(pos, 1.0);
 }
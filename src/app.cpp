@@ -1,6 +1,8 @@
 #include "app.hpp"
 #include "SDL3/SDL_video.h"
 #include <cstdint>
+#include <iostream>
+#include <string_view>
 
 #define GLM_ENABLE_EXPERIMENTAL
 
@@ -13,7 +15,9 @@
 
 #include "graphics/camera.hpp"
 #include "graphics/vulkan/renderer.hpp"
+#include "graphics/widgets/chunk_memory_widget.hpp"
 #include "graphics/widgets/render_time_widget.hpp"
+#include "graphics/widgets/streaming_widget.hpp"
 #include "graphics/widgets/terrain_widget.hpp"
 #include "graphics/widgets/util_widget.hpp"
 #include "graphics/widgets/widget.hpp"
@@ -24,6 +28,8 @@
 namespace craft {
 static SDL_GLContext ctx = nullptr;
 
+constexpr float const kBlockReach = 8.0f;
+
 App::~App() {
   if (ctx) {
     SDL_GL_DestroyContext(ctx);
@@ -34,10 +40,16 @@ App::~App() {
 
 void App::ParseParameters(int argc, char **argv) {
   for (int i = 0; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    if (arg == "--world" && i + 1 < argc) {
+      m_world_directory = argv[++i];
+    } else if (arg == "--full-saves") {
+      m_persistence_mode = PersistenceMode::Full;
+    }
   }
 }
 
-App::App(int argc, char **argv) : m_world{&m_noise} {
+App::App(int argc, char **argv) {
   ParseParameters(argc, argv);
 
   if (SDL_Init(SDL_INIT_VIDEO) == false) {
@@ -49,10 +61,20 @@ App::App(int argc, char **argv) : m_world{&m_noise} {
                         "operate, and must quit now.");
   }
 
-  m_chunk = std::make_unique<Chunk>();
-  GenerateChunk(false, 10.0f, m_noise, *m_chunk);
-
-  m_world.Generate();
+  m_chunk = MakeChunk();
+  // The test chunk keeps FastNoiseLite's defaults, with its own height and scale, and samples every column.
+  m_chunk_settings.seed = 1337;
+  m_chunk_settings.fractal_type = FastNoiseLite::FractalType_None;
+  m_chunk_settings.octaves = 3;
+  m_chunk_settings.max_height = 10.0f;
+  m_chunk_settings.scale = 10.0f;
+  m_chunk_settings.sample_spacing = 1;
+  m_chunk_generator.Generate(m_chunk_settings, {0, 0, 0}, *m_chunk);
+
+  if (!m_world.Open(m_world_directory, m_persistence_mode)) {
+    std::cout << "Couldn't open the world at " << m_world_directory << ", it won't be saved." << std::endl;
+    m_world.Generate();
+  }
 
   m_window = std::make_shared<Window>(1024, 768, "test");
   m_renderer = std::make_shared<vk::Renderer>(m_window, m_camera, &m_world);
@@ -60,8 +82,10 @@ App::App(int argc, char **argv) : m_world{&m_noise} {
   m_widget_manager = std::make_shared<WidgetManager>();
   m_widget_manager->AddWidget(std::make_unique<UtilWidget>());
   m_widget_manager->AddWidget(std::make_unique<RenderTimingsWidget>(&time_taken_to_render));
-  m_widget_manager->AddWidget(std::make_unique<TerrainWidget>(m_regenerate, m_noise, m_regenerate_with_one_block,
-                                                              m_scale_factor, m_max_height, m_current_block_type,
+  m_widget_manager->AddWidget(std::make_unique<ChunkMemoryWidget>());
+  m_widget_manager->AddWidget(std::make_unique<StreamingWidget>(m_world));
+  m_widget_manager->AddWidget(std::make_unique<TerrainWidget>(m_regenerate, m_chunk_settings,
+                                                              m_regenerate_with_one_block, m_current_block_type,
                                                               m_replace));
 }
 
@@ -215,7 +239,17 @@ bool App::Run() {
         m_camera.IncreaseMovementSpeedBy(5.0f);
       }
 
-      if (m_window->IsButtonPressed(1)) {
+      // Left click breaks the block under the crosshair, right click places the selected block in front of it (or
+      // replaces it in replace mode). The camera looks down -forward, see Camera::ViewMatrix().
+      if (m_window->IsButtonPressed(SDL_BUTTON_LEFT)) {
+        if (auto hit = m_world.Raycast(m_camera.GetPosition(), -m_camera.GetForward(), kBlockReach)) {
+          m_world.SetBlock(hit->block, BlockType::Air);
+        }
+      }
+      if (m_window->IsButtonPressed(SDL_BUTTON_RIGHT) && m_current_block_type != BlockType::Air) {
+        if (auto hit = m_world.Raycast(m_camera.GetPosition(), -m_camera.GetForward(), kBlockReach)) {
+          m_world.SetBlock(m_replace ? hit->block : hit->previous, m_current_block_type);
+        }
       }
 
       auto [x, y] = m_window->GetRelativeMouseMotion();
@@ -225,10 +259,19 @@ bool App::Run() {
     }
 
     if (m_regenerate) {
-      GenerateChunk(m_regenerate_with_one_block, m_max_height, m_noise, *m_chunk, m_scale_factor);
+      if (m_regenerate_with_one_block) {
+        FastNoiseLite noise;
+        m_chunk_settings.Apply(noise);
+        GenerateChunk(true, m_chunk_settings.max_height, noise, *m_chunk, m_chunk_settings.scale);
+      } else {
+        m_chunk_generator.Generate(m_chunk_settings, {0, 0, 0}, *m_chunk);
+      }
       m_renderer->InitDefaultData();
       m_regenerate = false;
     }
+
+    m_world.Update(m_camera.GetPosition());
+    m_renderer->UpdateDirtyChunkMeshes();
   }
 
   return true;
@@ -1,12 +1,14 @@
 #pragma once
 
+#include <filesystem>
 #include <memory>
 
 #include "graphics/vulkan/renderer.hpp"
 #include "graphics/widgets/widget.hpp"
 #include "platform/window.hpp"
 
-#include <FastNoiseLite/FastNoiseLite.h>
+#include "world/generation_pipeline.hpp"
+#include "world/generator.hpp"
 
 namespace craft {
 class App {
@@ -14,15 +16,18 @@ class App {
   std::shared_ptr<vk::Renderer> m_renderer;
 
   std::shared_ptr<WidgetManager> m_widget_manager;
-  std::unique_ptr<Chunk> m_chunk;
+  ChunkPtr m_chunk;
+  std::filesystem::path m_world_directory = "world";
+  // Only used when the world is created.
+  PersistenceMode m_persistence_mode = PersistenceMode::EditDeltas;
   World m_world;
 
   Camera m_camera;
-  FastNoiseLite m_noise;
+  GeneratorSettings m_chunk_settings;
+  // Only reruns the stages whose settings were changed in the terrain widget.
+  GenerationPipeline m_chunk_generator;
   bool m_regenerate = false;
   bool m_regenerate_with_one_block = false;
-  float m_scale_factor = 10.0f;
-  float m_max_height = 10.0f;
   BlockType m_current_block_type = BlockType::Air;
   bool m_replace = true;
 
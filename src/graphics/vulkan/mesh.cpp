@@ -1,156 +1,307 @@
 #include "mesh.hpp"
 
+#include <algorithm>
+#include <bit>
+#include <numeric>
+
 #include "math/vec.hpp"
 #include "renderer.hpp"
 #include "world/chunk.hpp"
 
 namespace craft::vk {
-MeshBuffers UploadMesh(Renderer *renderer, VkDevice device, VmaAllocator allocator, std::span<uint32_t> indices,
-                       std::span<Vertex> vertices) {
-  size_t vertex_size = vertices.size_bytes();
-  size_t index_size = indices.size_bytes();
+MeshBuffers UploadMesh(Renderer *renderer, VkDevice device, VmaAllocator allocator, std::span<const PackedFace> faces) {
+  return UploadMesh(renderer, device, allocator, static_cast<uint32_t>(faces.size()),
+                    [&](PackedFace *face_data) { memcpy(face_data, faces.data(), faces.size_bytes()); });
+}
+
+MeshBuffers UploadMesh(Renderer *renderer, VkDevice device, VmaAllocator allocator, uint32_t face_count,
+                       const std::function<void(PackedFace *)> &write) {
+  size_t size = face_count * sizeof(PackedFace);
 
   MeshBuffers mesh;
-  mesh.vertex = AllocateBuffer(allocator, vertex_size + index_size,
-                               VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT |
-                                   VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-                               VMA_MEMORY_USAGE_GPU_ONLY);
+  mesh.faces = AllocateBuffer(allocator, size,
+                              VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+                                  VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                              VMA_MEMORY_USAGE_GPU_ONLY);
 
   VkBufferDeviceAddressInfo addr_info{VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO};
-  addr_info.buffer = mesh.vertex.buffer;
+  addr_info.buffer = mesh.faces.buffer;
 
-  mesh.vertex_addr = vkGetBufferDeviceAddress(device, &addr_info);
+  mesh.faces_addr = vkGetBufferDeviceAddress(device, &addr_info);
 
   AllocatedBuffer staging =
-      AllocateBuffer(allocator, vertex_size + index_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
+      AllocateBuffer(allocator, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
 
   void *data;
   VK_CHECK(vmaMapMemory(allocator, staging.allocation, &data));
 
-  memcpy(data, vertices.data(), vertex_size);
-  memcpy(static_cast<char *>(data) + vertex_size, indices.data(), index_size);
+  write(static_cast<PackedFace *>(data));
 
   vmaUnmapMemory(allocator, staging.allocation);
+  renderer->QueueUpload(std::move(staging), mesh.faces.buffer, size);
 
-  // TODO: fucking optimize
-  renderer->SubmitNow([&](VkCommandBuffer cmd) {
-    VkBufferCopy vertex_copy{};
-    vertex_copy.size = vertex_size + index_size;
+  mesh.face_count = face_count;
+  return mesh;
+}
 
-    vkCmdCopyBuffer(cmd, staging.buffer, mesh.vertex.buffer, 1, &vertex_copy);
+// Axis a face looks along, 0 = X, 1 = Y, 2 = Z.
+static constexpr int kFaceAxis[kMeshFaceCount] = {2, 2, 0, 0, 1, 1};
 
-    // vertex_copy.srcOffset = vertex_size;
-    // vertex_copy.size = index_size;
+uint32_t GetFacingDirections(ChunkPos pos, const glm::vec3 &eye) {
+  // A face on plane p of its axis is turned towards the eye if the eye is past p on the side it looks to. The faces of
+  // a chunk lie on the planes from its near to its far edge, so only a chunk entirely behind the eye hides them all.
+  const int min[3] = {pos.x * static_cast<int>(kMaxChunkWidth), pos.y * static_cast<int>(kMaxChunkHeight),
+                      pos.z * static_cast<int>(kMaxChunkDepth)};
+  const int max[3] = {min[0] + static_cast<int>(kMaxChunkWidth), min[1] + static_cast<int>(kMaxChunkHeight),
+                      min[2] + static_cast<int>(kMaxChunkDepth)};
 
-    // vkCmdCopyBuffer(cmd, staging.buffer, mesh.index.buffer, 1, &vertex_copy);
-  });
+  uint32_t directions = 0;
+  for (int face = 0; face < kMeshFaceCount; ++face) {
+    const int axis = kFaceAxis[face];
+    // Front, Right and Top look to the positive side of their axis.
+    const bool positive = face == static_cast<int>(MeshFace::Front) || face == static_cast<int>(MeshFace::Right) ||
+                          face == static_cast<int>(MeshFace::Top);
+    if (positive ? eye[axis] > min[axis] : eye[axis] < max[axis]) {
+      directions |= 1u << face;
+    }
+  }
+  return directions;
+}
 
-  DestroyBuffer(allocator, std::move(staging));
-  mesh.vertex_size = vertex_size;
-  mesh.index_size = index_size;
-  return mesh;
+// Masks of the columns next to column (z, x) in each direction, from one kind of ColumnMasks and the matching border
+// masks for the chunk's edges.
+static void GetNeighborMasks(const uint64_t (&masks)[kMaxChunkDepth][kMaxChunkWidth],
+                             const ChunkBorders::Masks &borders, int z, int x, uint64_t (&out)[6]) {
+  const uint64_t column = masks[z][x];
+  out[static_cast<int>(MeshFace::Front)] = z == kMaxChunkDepth - 1 ? borders.front[x] : masks[z + 1][x];
+  out[static_cast<int>(MeshFace::Back)] = z == 0 ? borders.back[x] : masks[z - 1][x];
+  out[static_cast<int>(MeshFace::Left)] = x == 0 ? borders.left[z] : masks[z][x - 1];
+  out[static_cast<int>(MeshFace::Right)] = x == kMaxChunkWidth - 1 ? borders.right[z] : masks[z][x + 1];
+  out[static_cast<int>(MeshFace::Top)] =
+      (column >> 1) | (static_cast<uint64_t>((borders.top[z] >> x) & 1) << (kMaxChunkHeight - 1));
+  out[static_cast<int>(MeshFace::Bottom)] = (column << 1) | ((borders.bottom[z] >> x) & 1);
 }
 
-enum class MeshFace { Front, Back, Left, Right, Top, Bottom, Count };
-
-static bool ShouldRender(Chunk *chunk, MeshFace face, int z, int x, int y) {
-  switch (face) {
-  case MeshFace::Front:
-    return z == (kMaxChunkDepth - 1) || chunk->blocks[z + 1][x][y].block_type == BlockType::Air;
-  case MeshFace::Back:
-    return z == 0 || chunk->blocks[z - 1][x][y].block_type == BlockType::Air;
-  case MeshFace::Left:
-    return x == 0 || chunk->blocks[z][x - 1][y].block_type == BlockType::Air;
-  case MeshFace::Right:
-    return x == (kMaxChunkWidth - 1) || chunk->blocks[z][x + 1][y].block_type == BlockType::Air;
-  case MeshFace::Top:
-    return y == (kMaxChunkHeight - 1) || chunk->blocks[z][x][y + 1].block_type == BlockType::Air;
-  case MeshFace::Bottom:
-    return y == 0 || chunk->blocks[z][x][y - 1].block_type == BlockType::Air;
-
-  default:
-    return true;
+// Faces of a column that need drawing, bit y of each mask set when block y of column (z, x) shows a face in that
+// direction. Opaque blocks show it unless their neighbor is opaque too, so the ground under water is still drawn, and
+// translucent blocks only next to air, so the inside of a lake isn't. Faces on the chunk's border are culled against
+// `borders`.
+static void GetVisibleFaces(const ColumnMasks &columns, const ChunkBorders &borders, int z, int x,
+                            uint64_t (&visible)[6]) {
+  uint64_t occupied[6];
+  uint64_t opaque[6];
+  GetNeighborMasks(columns.masks, borders.occupied, z, x, occupied);
+  GetNeighborMasks(columns.opaque, borders.opaque, z, x, opaque);
+
+  const uint64_t solid = columns.opaque[z][x];
+  const uint64_t translucent = columns.masks[z][x] & ~solid;
+  for (int face = 0; face < kMeshFaceCount; ++face) {
+    visible[face] = (solid & ~opaque[face]) | (translucent & ~occupied[face]);
   }
 }
 
-ChunkMesh ChunkMesh::GenerateChunkMeshFromChunk(Chunk *chunk) {
-  ChunkMesh mesh;
-  mesh.indices.reserve(1 << 20);
-  mesh.vertices.reserve(1 << 21);
-
-  static constexpr Rect GRASS_TEXTURE = {64.0f / 512.0f, 32.0f / 512.0f, 32.0f / 512.0f, 32.0f / 512.0f};
-  static constexpr Rect DIRT_TEXTURE = {0.0f / 512.0f, 32.0f / 512.0f, 32.0f / 512.0f, 32.0f / 512.0f};
-  static constexpr Rect DIRT_WITH_GRASS = {32.0f / 512.0f, 32.0f / 512.0f, 32.0f / 512.0f, 32.0f / 512.0f};
-  static constexpr Rect LAVA_TEXTURE = {64.0f / 512.0f, 0.0f / 512.0f, 32.0f / 512.0f, 32.0f / 512.0f};
-
-  static constexpr Rect TEXTURE_LOOKUP[static_cast<int>(BlockType::Count)][static_cast<int>(MeshFace::Count)] = {
-      {DIRT_TEXTURE, DIRT_TEXTURE, DIRT_TEXTURE, DIRT_TEXTURE, DIRT_TEXTURE, DIRT_TEXTURE},
-      {DIRT_WITH_GRASS, DIRT_WITH_GRASS, DIRT_WITH_GRASS, DIRT_WITH_GRASS, GRASS_TEXTURE, DIRT_TEXTURE},
-      {LAVA_TEXTURE, LAVA_TEXTURE, LAVA_TEXTURE, LAVA_TEXTURE, LAVA_TEXTURE, LAVA_TEXTURE},
-  };
+// Records the quad of `face` from block `origin` on (in X Y Z), `width` by `height` blocks along its plane axes.
+static void EmitFace(std::vector<PackedFace> &faces, MeshFace face, const int (&origin)[3], int width, int height,
+                     BlockType block) {
+  faces.emplace_back(static_cast<uint8_t>(origin[0]), static_cast<uint8_t>(origin[1]), static_cast<uint8_t>(origin[2]),
+                     static_cast<uint8_t>(face), static_cast<uint8_t>(width), static_cast<uint8_t>(height), block);
+}
+
+// Calls fn(face, x, y, z, block) for every block face that needs to be drawn, section by section in Z X Y order.
+// Visibility comes from the column masks, so only blocks with at least one visible face are ever read.
+template <typename F> static void ForEachVisibleFace(const ChunkData &chunk, const ChunkBorders &borders, F &&fn) {
+  static_assert(kMaxChunkHeight == 64, "a column mask holds one column");
+  const ColumnMasks &columns = chunk.GetColumnMasks();
+
+  for (int section = 0; section < kSectionsPerChunk; ++section) {
+    // Nothing to emit for an all-air section, skip its whole volume.
+    if (chunk.IsSectionEmpty(section))
+      continue;
 
-  for (int z = 0; z < kMaxChunkDepth; ++z) {
-    for (int x = 0; x < kMaxChunkWidth; ++x) {
-      for (int y = 0; y < kMaxChunkHeight; ++y) {
-        const auto &block = chunk->blocks[z][x][y];
-        if (block.block_type == BlockType::Air)
+    const uint64_t section_bits = (~0ULL >> (kMaxChunkHeight - kSectionSize)) << (section * kSectionSize);
+    for (int z = 0; z < kMaxChunkDepth; ++z) {
+      for (int x = 0; x < kMaxChunkWidth; ++x) {
+        if ((columns.masks[z][x] & section_bits) == 0)
           continue;
 
-        BlockType current_type = block.block_type;
-        for (int face = 0; face < 6; face++) {
-          MeshFace current_face = static_cast<MeshFace>(face);
-          if (!ShouldRender(chunk, current_face, z, x, y))
-            continue;
-
-          uint8_t tex_index = 1;
-          switch (current_type) {
-          case BlockType::Dirt:
-            if (current_face == MeshFace::Top) {
-              tex_index = 18;
-            } else if (current_face == MeshFace::Bottom) {
-              tex_index = 16;
-            } else {
-              tex_index = 17;
+        uint64_t visible[6];
+        GetVisibleFaces(columns, borders, z, x, visible);
+
+        uint64_t any = (visible[0] | visible[1] | visible[2] | visible[3] | visible[4] | visible[5]) & section_bits;
+        for (; any != 0; any &= any - 1) {
+          const int y = std::countr_zero(any);
+          const BlockType type = chunk.Get(z, x, y);
+          for (int face = 0; face < 6; face++) {
+            if ((visible[face] >> y) & 1) {
+              fn(static_cast<MeshFace>(face), x, y, z, type);
             }
-            break;
-          case BlockType::Lava:
-            tex_index = 2;
-            break;
-          case BlockType::Water:
-            tex_index = 3;
-            break;
-
-          case BlockType::Stone:
-            tex_index = 1;
-            break;
-
-          case BlockType::Wood:
-            tex_index = 0;
-            break;
-
-          case BlockType::Air:
-          case BlockType::Count:
-            break;
+          }
+        }
+      }
+    }
+  }
+}
+
+static void MeshPerFace(const ChunkData &chunk, const ChunkBorders &borders, std::vector<PackedFace> &faces) {
+  ForEachVisibleFace(chunk, borders, [&](MeshFace face, int x, int y, int z, BlockType block) {
+    EmitFace(faces, face, {x, y, z}, 1, 1, block);
+  });
+}
+
+// Visible faces of a chunk sorted into 2D slices along each face's axis. The plane axes of a slice are X and Z for top
+// and bottom faces, otherwise the horizontal axis and Y; every row along the first one is a bitmask.
+struct FaceMasks {
+  static_assert(kMaxChunkWidth <= 32 && kMaxChunkDepth <= 32, "a row of a slice is 32 bits");
+  static_assert(PackedFace::kMaxSize >= 32, "a run along a row fits a face");
+
+  static constexpr int kSize[3] = {kMaxChunkWidth, kMaxChunkHeight, kMaxChunkDepth};
+  static constexpr int kMaxSlices = std::max({kMaxChunkWidth, kMaxChunkHeight, kMaxChunkDepth});
+
+  static constexpr int UAxis(int axis) { return axis == 0 ? 2 : 0; }
+  static constexpr int VAxis(int axis) { return axis == 1 ? 2 : 1; }
+
+  // [face][slice][v], bit u set where there's a face. Only valid for used slices.
+  uint32_t rows[kMeshFaceCount][kMaxSlices][kMaxSlices];
+  // [face][slice * plane size + v * u size + u], the block of each face. Only valid where its row bit is set.
+  BlockType blocks[kMeshFaceCount][kChunkVolume];
+  // Whether a slice has any face at all.
+  bool used[kMeshFaceCount][kMaxSlices];
+};
+
+// Covers the visible faces of every slice with as few rectangles as possible: each rectangle grows along the first
+// plane axis while the block type matches, then along the second while the whole row matches, up to
+// PackedFace::kMaxSize either way. Rows are scanned with bit operations, so empty parts of a slice cost nothing.
+static void MeshGreedy(const ChunkData &chunk, const ChunkBorders &borders, FaceMasks &masks,
+                       std::vector<PackedFace> &faces) {
+  memset(masks.used, 0, sizeof(masks.used));
+  ForEachVisibleFace(chunk, borders, [&](MeshFace face, int x, int y, int z, BlockType block) {
+    const int face_index = static_cast<int>(face);
+    const int axis = kFaceAxis[face_index];
+    const int pos[3] = {x, y, z};
+    const int u = pos[FaceMasks::UAxis(axis)];
+    const int v = pos[FaceMasks::VAxis(axis)];
+    const int u_size = FaceMasks::kSize[FaceMasks::UAxis(axis)];
+    const int plane_size = kChunkVolume / FaceMasks::kSize[axis];
+
+    uint32_t *rows = masks.rows[face_index][pos[axis]];
+    if (!masks.used[face_index][pos[axis]]) {
+      masks.used[face_index][pos[axis]] = true;
+      std::fill_n(rows, FaceMasks::kMaxSlices, 0);
+    }
+    rows[v] |= 1u << u;
+    masks.blocks[face_index][pos[axis] * plane_size + v * u_size + u] = block;
+  });
+
+  for (int face_index = 0; face_index < kMeshFaceCount; ++face_index) {
+    const MeshFace face = static_cast<MeshFace>(face_index);
+    const int axis = kFaceAxis[face_index];
+    const int u_axis = FaceMasks::UAxis(axis);
+    const int v_axis = FaceMasks::VAxis(axis);
+    const int u_size = FaceMasks::kSize[u_axis];
+    const int v_size = FaceMasks::kSize[v_axis];
+
+    for (int slice = 0; slice < FaceMasks::kSize[axis]; ++slice) {
+      if (!masks.used[face_index][slice]) {
+        continue;
+      }
+
+      uint32_t *rows = masks.rows[face_index][slice];
+      const BlockType *blocks = &masks.blocks[face_index][slice * u_size * v_size];
+      for (int v = 0; v < v_size; ++v) {
+        while (rows[v] != 0) {
+          const int u = std::countr_zero(rows[v]);
+          const BlockType block = blocks[v * u_size + u];
+
+          // Bounded by the run of set bits first, then by the block type. A row is 32 bits, so it can't be longer than
+          // PackedFace::kMaxSize.
+          const int run = std::countr_one(rows[v] >> u);
+          int width = 1;
+          while (width < run && blocks[v * u_size + u + width] == block) {
+            ++width;
           }
 
-          uint32_t base_index = mesh.vertices.size();
+          const uint32_t span = (width == 32 ? ~0u : (1u << width) - 1) << u;
+          int height = 1;
+          for (; v + height < v_size && height < PackedFace::kMaxSize; ++height) {
+            const BlockType *row = &blocks[(v + height) * u_size + u];
+            if ((rows[v + height] & span) != span ||
+                !std::all_of(row, row + width, [&](BlockType entry) { return entry == block; })) {
+              break;
+            }
+          }
 
-          mesh.vertices.push_back(Vertex(x, y, z, face, 0, tex_index, 0));
-          mesh.vertices.push_back(Vertex(x, y, z, face, 1, tex_index, 0));
-          mesh.vertices.push_back(Vertex(x, y, z, face, 2, tex_index, 0));
-          mesh.vertices.push_back(Vertex(x, y, z, face, 3, tex_index, 0));
+          for (int dv = 0; dv < height; ++dv) {
+            rows[v + dv] &= ~span;
+          }
 
-          mesh.indices.push_back(base_index);
-          mesh.indices.push_back(base_index + 1);
-          mesh.indices.push_back(base_index + 2);
-          mesh.indices.push_back(base_index);
-          mesh.indices.push_back(base_index + 2);
-          mesh.indices.push_back(base_index + 3);
+          int origin[3];
+          origin[axis] = slice;
+          origin[u_axis] = u;
+          origin[v_axis] = v;
+          EmitFace(faces, face, origin, width, height, block);
         }
       }
     }
   }
+}
+
+ChunkMesher::ChunkMesher() : m_masks{std::make_unique<FaceMasks>()} {}
+
+ChunkMesher::~ChunkMesher() = default;
+
+uint32_t ChunkMesher::Mesh(const ChunkData &chunk, const ChunkBorders &borders, MeshingMode mode) {
+  m_faces.clear();
+  m_unsorted.clear();
+  std::fill_n(&m_direction_counts[0][0], kMeshPassCount * kMeshFaceCount, 0);
+  if (chunk.IsEmpty()) {
+    return 0;
+  }
+
+  if (mode == MeshingMode::Greedy) {
+    MeshGreedy(chunk, borders, *m_masks, m_unsorted);
+  } else {
+    MeshPerFace(chunk, borders, m_unsorted);
+  }
+
+  // Counting sort by pass, then direction.
+  auto bucket = [](PackedFace face) {
+    return static_cast<int>(face.GetPass()) * kMeshFaceCount + static_cast<int>(face.GetFace());
+  };
+  uint32_t *counts = &m_direction_counts[0][0];
+  for (PackedFace face : m_unsorted) {
+    counts[bucket(face)] += 1;
+  }
+
+  uint32_t offsets[kMeshPassCount * kMeshFaceCount];
+  std::exclusive_scan(counts, counts + kMeshPassCount * kMeshFaceCount, offsets, 0u);
+
+  m_faces.resize(m_unsorted.size());
+  for (PackedFace face : m_unsorted) {
+    m_faces[offsets[bucket(face)]++] = face;
+  }
+
+  return GetFaceCount();
+}
+
+void ChunkMesher::Write(PackedFace *faces) const { std::copy(m_faces.begin(), m_faces.end(), faces); }
+
+void ChunkMesher::Write(ChunkMesh &out) const {
+  out.faces.assign(m_faces.begin(), m_faces.end());
+  std::copy_n(&m_direction_counts[0][0], kMeshPassCount * kMeshFaceCount, &out.direction_counts[0][0]);
+}
 
+ChunkMesher &ChunkMesher::GetThreadLocal() {
+  static thread_local ChunkMesher mesher;
+  return mesher;
+}
+
+ChunkMesh ChunkMesh::GenerateChunkMeshFromChunk(const ChunkData &chunk, const ChunkBorders &borders,
+                                                MeshingMode mode) {
+  ChunkMesher &mesher = ChunkMesher::GetThreadLocal();
+  mesher.Mesh(chunk, borders, mode);
+
+  ChunkMesh mesh;
+  mesher.Write(mesh);
   return mesh;
 }
 } // namespace craft::vk
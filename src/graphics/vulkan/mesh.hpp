@@ -4,7 +4,10 @@
 
 #include <glm/glm.hpp>
 
+#include <functional>
+#include <memory>
 #include <span>
+#include <vector>
 
 #include "buffer.hpp"
 #include "world/chunk.hpp"
@@ -12,19 +15,42 @@
 namespace craft::vk {
 class Renderer;
 
-struct Vertex {
+// The direction a block face looks in, Front being +Z.
+enum class MeshFace { Front, Back, Left, Right, Top, Bottom, Count };
+
+constexpr int const kMeshFaceCount = static_cast<int>(MeshFace::Count);
+
+// Opaque faces are drawn first, front to back, then translucent ones (see IsTranslucent()) back to front over them.
+enum class MeshPass { Opaque, Translucent, Count };
+
+constexpr int const kMeshPassCount = static_cast<int>(MeshPass::Count);
+
+// A quad of block faces in one 32-bit word, textured_mesh.vert expands it into its corners from gl_VertexIndex. The
+// position is the quad's first block, the size is in blocks along the face's two plane axes (see FaceMasks) and the
+// shader picks the texture from the block type and face.
+struct PackedFace {
+  // Merged quads are split at this size along either plane axis, so the sizes fit their bits.
+  static constexpr int const kMaxSize = 32;
+
   uint32_t data = 0;
 
-  Vertex(uint8_t x, uint8_t y, uint8_t z, uint8_t face, uint8_t corner, uint16_t tex_id, uint8_t ao) {
-    data |= (x & 0x1F) << 0;        // 5 bits
-    data |= (y & 0x3F) << 5;        // 6 bits
-    data |= (z & 0x1F) << 11;       // 5 bits
-    data |= (face & 0x07) << 16;    // 3 bits
-    data |= (corner & 0x03) << 19;  // 2 bits
-    data |= (tex_id & 0x1FF) << 21; // 9 bits
-    data |= (ao & 0x03) << 30;      // 2 bits
+  PackedFace() = default;
+  PackedFace(uint8_t x, uint8_t y, uint8_t z, uint8_t face, uint8_t width, uint8_t height, BlockType block) {
+    data |= (x & 0x1F) << 0;                             // 5 bits
+    data |= (y & 0x3F) << 5;                             // 6 bits
+    data |= (z & 0x1F) << 11;                            // 5 bits
+    data |= (face & 0x07) << 16;                         // 3 bits
+    data |= ((width - 1) & 0x1F) << 19;                  // 5 bits
+    data |= ((height - 1) & 0x1F) << 24;                 // 5 bits
+    data |= (static_cast<uint32_t>(block) & 0x07) << 29; // 3 bits
   }
+
+  MeshFace GetFace() const { return static_cast<MeshFace>((data >> 16) & 0x07); }
+  BlockType GetBlock() const { return static_cast<BlockType>(data >> 29); }
+  MeshPass GetPass() const { return IsTranslucent(GetBlock()) ? MeshPass::Translucent : MeshPass::Opaque; }
 };
+static_assert(kMaxChunkWidth <= 32 && kMaxChunkDepth <= 32 && kMaxChunkHeight <= 64, "face positions overflow");
+static_assert(static_cast<int>(BlockType::Count) <= 8, "face block types overflow");
 
 /*
 struct Vertex {
@@ -39,26 +65,89 @@ struct Vtx_ {
   glm::vec2 uv;
   glm::vec2 _pad2;
 };
+// Drawn without an index buffer, six vertices per face.
 struct MeshBuffers {
-  AllocatedBuffer vertex;
-  VkDeviceAddress vertex_addr;
-  Chunk *chunk;
-  uint32_t vertex_size, index_size;
+  AllocatedBuffer faces;
+  VkDeviceAddress faces_addr;
+  ChunkPos pos;
+  uint32_t face_count;
+  // See ChunkMesh::direction_counts.
+  uint32_t direction_counts[kMeshPassCount][kMeshFaceCount];
 };
 
-MeshBuffers UploadMesh(Renderer *renderer, VkDevice device, VmaAllocator allocator, std::span<uint32_t> indices,
-                       std::span<Vertex> vertices);
+// The faces are copied by the renderer's next frame, before it draws, see Renderer::QueueUpload().
+MeshBuffers UploadMesh(Renderer *renderer, VkDevice device, VmaAllocator allocator, std::span<const PackedFace> faces);
+// Same, but `write` fills the mapped staging memory with `face_count` faces directly.
+MeshBuffers UploadMesh(Renderer *renderer, VkDevice device, VmaAllocator allocator, uint32_t face_count,
+                       const std::function<void(PackedFace *)> &write);
 
 struct DrawPushConstants {
   glm::mat4 projection;
   // Mat<float, 4, 4> world;
-  VkDeviceAddress vertex_buffer;
+  VkDeviceAddress face_buffer;
+};
+
+// The directions, bit i for MeshFace i, in which some face of chunk `pos` could be turned towards a camera at `eye`.
+// Faces of the others all point away from it, e.g. the Right (+X) faces of a chunk entirely to the camera's +X side.
+uint32_t GetFacingDirections(ChunkPos pos, const glm::vec3 &eye);
+
+// Bumped whenever the mesher's output for the same blocks changes, meshes cached by other versions are thrown away.
+constexpr uint32_t const kMesherVersion = 2;
+
+enum class MeshingMode {
+  // One quad per visible block face.
+  PerFace,
+  // Merges adjacent coplanar faces with the same texture into larger quads.
+  Greedy,
+};
+
+struct ChunkMesh;
+struct FaceMasks;
+
+// Meshes chunks into scratch memory that's reused from call to call, so once it has grown to fit the largest chunk
+// seen, meshing doesn't allocate. The faces are then copied out at their exact count, straight to wherever the caller
+// wants them (e.g. the mapped staging memory of UploadMesh()). Either way they come out grouped by pass, and within a
+// pass by direction.
+class ChunkMesher {
+public:
+  ChunkMesher();
+  ~ChunkMesher();
+
+  ChunkMesher(const ChunkMesher &) = delete;
+  ChunkMesher &operator=(const ChunkMesher &) = delete;
+
+  // Meshes the chunk, faces against `borders` are culled like faces inside it (see Chunk::GetBorders()). Returns the
+  // number of faces, which stay available for Write() until the next call.
+  uint32_t Mesh(const ChunkData &chunk, const ChunkBorders &borders, MeshingMode mode = MeshingMode::Greedy);
+
+  uint32_t GetFaceCount() const { return static_cast<uint32_t>(m_faces.size()); }
+  const auto &GetDirectionCounts() const { return m_direction_counts; }
+
+  // `faces` needs room for GetFaceCount() entries.
+  void Write(PackedFace *faces) const;
+  // Resizes the mesh to fit, it only reallocates if it has to grow.
+  void Write(ChunkMesh &out) const;
+
+  // One per thread, for callers that don't keep their own.
+  static ChunkMesher &GetThreadLocal();
+
+private:
+  std::vector<PackedFace> m_faces;
+  uint32_t m_direction_counts[kMeshPassCount][kMeshFaceCount] = {};
+  // Faces as the meshing passes find them, they're sorted by pass and direction from here into m_faces.
+  std::vector<PackedFace> m_unsorted;
+  std::unique_ptr<FaceMasks> m_masks;
 };
 
 struct ChunkMesh {
-  std::vector<Vertex> vertices;
-  std::vector<uint32_t> indices;
+  std::vector<PackedFace> faces;
+  // How many of the faces of each pass look in each direction. The faces are stored pass by pass in MeshPass order,
+  // those of a direction together in MeshFace order, so the renderer can draw the passes separately and skip the
+  // directions turned away from the camera (see GetFacingDirections()).
+  uint32_t direction_counts[kMeshPassCount][kMeshFaceCount] = {};
 
-  static ChunkMesh GenerateChunkMeshFromChunk(Chunk *chunk);
+  // Meshes with the thread's ChunkMesher into a buffer of the exact size.
+  static ChunkMesh GenerateChunkMeshFromChunk(const ChunkData &chunk, const ChunkBorders &borders,
+                                              MeshingMode mode = MeshingMode::Greedy);
 };
 } // namespace craft::vk
@@ -0,0 +1,206 @@
+#include "mesh_cache.hpp"
+
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+#include <numeric>
+#include <system_error>
+
+namespace craft::vk {
+namespace {
+// Changes with the layout of the records, like kMesherVersion does with their contents.
+constexpr char const kMeshCacheMagic[4] = {'C', 'R', 'M', '2'};
+
+// Magic and mesher version, then the records. Everything is stored little-endian.
+constexpr size_t const kMeshCacheHeaderSize = 8;
+
+// Followed by the record's faces.
+struct RecordHeader {
+  uint64_t key;
+  // Of the key and everything after this field, see Checksum().
+  uint32_t checksum;
+  uint32_t face_count;
+  uint32_t direction_counts[kMeshPassCount][kMeshFaceCount];
+};
+static_assert(sizeof(RecordHeader) == 8 + 4 + 4 + kMeshPassCount * kMeshFaceCount * 4, "records have no padding");
+
+uint64_t Mix(uint64_t hash, uint64_t value) {
+  hash = (hash ^ value) * 0x9E3779B97F4A7C15ULL;
+  return hash ^ (hash >> 32);
+}
+
+// `size` is a multiple of 4, like every part of a record.
+uint32_t Checksum(uint64_t key, const uint8_t *data, size_t size) {
+  uint64_t hash = Mix(0xCBF29CE484222325ULL, key);
+  for (size_t i = 0; i < size; i += sizeof(uint32_t)) {
+    uint32_t word;
+    std::memcpy(&word, data + i, sizeof(word));
+    hash = Mix(hash, word);
+  }
+  return static_cast<uint32_t>(hash);
+}
+
+// Reads the header of the record at `offset` and returns the size of the whole record, or 0 if it's cut short or
+// damaged. Counts that don't add up to the face count would have draws read past the end of the mesh's buffer.
+size_t ReadRecord(std::span<const uint8_t> view, size_t offset, RecordHeader &header) {
+  if (offset + sizeof(RecordHeader) > view.size()) {
+    return 0;
+  }
+  std::memcpy(&header, view.data() + offset, sizeof(RecordHeader));
+
+  const size_t size = sizeof(RecordHeader) + static_cast<size_t>(header.face_count) * sizeof(PackedFace);
+  if (offset + size > view.size()) {
+    return 0;
+  }
+
+  uint64_t total = 0;
+  for (const auto &counts : header.direction_counts) {
+    total = std::accumulate(std::begin(counts), std::end(counts), total);
+  }
+  const size_t checked = offsetof(RecordHeader, face_count);
+  if (total != header.face_count ||
+      Checksum(header.key, view.data() + offset + checked, size - checked) != header.checksum) {
+    return 0;
+  }
+
+  return size;
+}
+
+template <typename T> void Append(std::vector<uint8_t> &out, const T *data, size_t count) {
+  const uint8_t *bytes = reinterpret_cast<const uint8_t *>(data);
+  out.insert(out.end(), bytes, bytes + count * sizeof(T));
+}
+} // namespace
+
+uint64_t GetMeshKey(const ChunkData &chunk, const ChunkBorders &borders) {
+  uint64_t hash = 0xCBF29CE484222325ULL;
+  for (int i = 0; i < kSectionsPerChunk; ++i) {
+    const ChunkSection &section = chunk.GetSection(i);
+    hash = Mix(hash, (static_cast<uint64_t>(section.GetBitsPerEntry()) << 32) | section.GetPaletteSize());
+    for (BlockType type : section.GetPalette()) {
+      hash = Mix(hash, static_cast<uint64_t>(type));
+    }
+    for (uint64_t word : section.GetWords()) {
+      hash = Mix(hash, word);
+    }
+  }
+
+  static_assert(sizeof(ChunkBorders) % sizeof(uint64_t) == 0, "borders are hashed a word at a time");
+  uint64_t words[sizeof(ChunkBorders) / sizeof(uint64_t)];
+  std::memcpy(words, &borders, sizeof(ChunkBorders));
+  for (uint64_t word : words) {
+    hash = Mix(hash, word);
+  }
+
+  return hash;
+}
+
+bool MeshCache::Open(const std::filesystem::path &path) {
+  std::lock_guard lock{m_mutex};
+  m_path = path;
+  m_index.clear();
+  m_end = 0;
+  if (!m_file.Open(path)) {
+    return false;
+  }
+
+  auto view = m_file.Map();
+  uint32_t version = 0;
+  if (view.size() >= kMeshCacheHeaderSize) {
+    std::memcpy(&version, view.data() + 4, sizeof(version));
+  }
+
+  if (view.size() < kMeshCacheHeaderSize ||
+      std::memcmp(view.data(), kMeshCacheMagic, sizeof(kMeshCacheMagic)) != 0 || version != kMesherVersion) {
+    return StartOver();
+  }
+
+  size_t offset = kMeshCacheHeaderSize;
+  RecordHeader header;
+  while (size_t size = ReadRecord(view, offset, header)) {
+    m_index[header.key] = offset;
+    offset += size;
+  }
+
+  // Anything past the last intact record (one cut short by a crash while it was written, or damaged) is dropped, the
+  // next record overwrites it.
+  m_end = offset;
+  return true;
+}
+
+bool MeshCache::IsOpen() {
+  std::lock_guard lock{m_mutex};
+  return m_file.IsOpen();
+}
+
+bool MeshCache::Load(uint64_t key, ChunkMesh &out) {
+  std::lock_guard lock{m_mutex};
+  auto it = m_index.find(key);
+  if (it == m_index.end()) {
+    return false;
+  }
+
+  // Only what Open() or Store() vouched for, the file may go on past it.
+  auto view = m_file.Map().first(m_end);
+  RecordHeader header;
+  if (ReadRecord(view, it->second, header) == 0) {
+    m_index.erase(it);
+    return false;
+  }
+
+  out.faces.resize(header.face_count);
+  std::memcpy(out.faces.data(), view.data() + it->second + sizeof(RecordHeader),
+              header.face_count * sizeof(PackedFace));
+  std::memcpy(out.direction_counts, header.direction_counts, sizeof(header.direction_counts));
+  return true;
+}
+
+void MeshCache::Store(uint64_t key, const ChunkMesh &mesh) {
+  std::lock_guard lock{m_mutex};
+  if (!m_file.IsOpen() || m_index.contains(key)) {
+    return;
+  }
+
+  RecordHeader header{key, 0, static_cast<uint32_t>(mesh.faces.size())};
+  if (m_end + sizeof(RecordHeader) + header.face_count * sizeof(PackedFace) > kMaxMeshCacheSize && !StartOver()) {
+    return;
+  }
+
+  std::memcpy(header.direction_counts, mesh.direction_counts, sizeof(header.direction_counts));
+  m_record.clear();
+  Append(m_record, &header, 1);
+  Append(m_record, mesh.faces.data(), mesh.faces.size());
+
+  const size_t checked = offsetof(RecordHeader, face_count);
+  header.checksum = Checksum(key, m_record.data() + checked, m_record.size() - checked);
+  std::memcpy(m_record.data() + offsetof(RecordHeader, checksum), &header.checksum, sizeof(header.checksum));
+  if (!m_file.Write(m_end, m_record)) {
+    return;
+  }
+
+  m_index[key] = m_end;
+  m_end += m_record.size();
+}
+
+bool MeshCache::StartOver() {
+  // The file is recreated rather than overwritten, so nothing of the old one is left past the new records.
+  m_file.Close();
+  m_index.clear();
+  std::error_code error;
+  std::filesystem::remove(m_path, error);
+  if (error || !m_file.Open(m_path)) {
+    return false;
+  }
+
+  uint8_t header[kMeshCacheHeaderSize];
+  std::memcpy(header, kMeshCacheMagic, sizeof(kMeshCacheMagic));
+  std::memcpy(header + 4, &kMesherVersion, sizeof(kMesherVersion));
+  if (!m_file.Write(0, header)) {
+    m_file.Close();
+    return false;
+  }
+
+  m_end = kMeshCacheHeaderSize;
+  return true;
+}
+} // namespace craft::vk
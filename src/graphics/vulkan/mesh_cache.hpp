@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "mesh.hpp"
+#include "platform/mapped_file.hpp"
+#include "world/chunk.hpp"
+
+namespace craft::vk {
+// Hash of everything a chunk's (greedy) mesh depends on: the chunk's packed sections and the borders of its neighbors.
+// Equal blocks packed differently (e.g. with their palette in another order) hash differently, that only costs a miss.
+uint64_t GetMeshKey(const ChunkData &chunk, const ChunkBorders &borders);
+
+// Chunk meshes kept on disk across runs, so chunks whose blocks haven't changed since they were last meshed (e.g. all
+// of them when a saved world is opened again) don't need meshing. Meshes are appended to a single file, read through a
+// memory mapping and looked up by GetMeshKey() in an index that's rebuilt from the file when it's opened. Records are
+// checksummed, the file is cut back to the last intact one, e.g. after a crash while one was written. A file written by
+// another version of the mesher is started over, and so is the cache once it would grow past
+// kMaxMeshCacheSize, which drops the meshes of chunks that have changed since. Safe to use from any thread.
+class MeshCache {
+public:
+  static constexpr size_t const kMaxMeshCacheSize = 256 * 1024 * 1024;
+
+  bool Open(const std::filesystem::path &path);
+  bool IsOpen();
+
+  // Returns false, leaving `out` untouched, if there's no mesh stored under `key`.
+  bool Load(uint64_t key, ChunkMesh &out);
+  // Does nothing if a mesh is already stored under `key`.
+  void Store(uint64_t key, const ChunkMesh &mesh);
+
+private:
+  // Empties the cache.
+  bool StartOver();
+
+private:
+  std::mutex m_mutex;
+  std::filesystem::path m_path;
+  MappedFile m_file;
+
+  // Offset of each mesh's record in the file.
+  std::unordered_map<uint64_t, size_t> m_index;
+  // Where the next record goes, past the last intact one.
+  size_t m_end = 0;
+  // Scratch for building a record, so it's written in one go.
+  std::vector<uint8_t> m_record;
+};
+} // namespace craft::vk
@@ -0,0 +1,253 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "mesh.hpp"
+#include "mesh_cache.hpp"
+#include "world/chunk.hpp"
+#include "world/chunk_map.hpp"
+
+namespace craft::vk {
+// Meshes chunk snapshots on background threads. Jobs are submitted and results collected on one thread (the render
+// thread), which never waits on the workers: finished meshes come back through a lock-free list that Drain() empties.
+//
+// Every chunk has at most one job that counts. Submitting a chunk again supersedes its previous job and Cancel() drops
+// it, a superseded job is skipped if it hasn't started yet and its result is discarded if it has.
+//
+// Results are recycled once Drain() has handed them out, along with their mesh buffers, and each worker meshes with its
+// own ChunkMesher, so remeshing chunks that are already loaded doesn't allocate once everything has warmed up.
+//
+// With a MeshCache, workers look every chunk up in it first and only mesh the ones that miss, storing what they mesh.
+class MeshingService {
+public:
+  // Jobs with a lower priority value run first, equal priorities in submission order.
+  static constexpr uint32_t const kEditPriority = 0;
+
+  explicit MeshingService(MeshCache *cache = nullptr, size_t workers = DefaultWorkerCount()) : m_cache{cache} {
+    for (size_t i = 0; i < std::max<size_t>(workers, 1); ++i) {
+      m_threads.emplace_back([this] { WorkerLoop(); });
+    }
+  }
+
+  ~MeshingService() {
+    {
+      std::lock_guard lock{m_mutex};
+      m_stop = true;
+    }
+    m_wake.notify_all();
+
+    for (auto &thread : m_threads) {
+      thread.join();
+    }
+
+    for (std::atomic<Result *> *list : {&m_results, &m_free}) {
+      for (Result *result = list->exchange(nullptr); result;) {
+        delete std::exchange(result, result->next);
+      }
+    }
+    for (Result *result : m_spare) {
+      delete result;
+    }
+    for (size_t i = m_ready_head; i < m_ready.size(); ++i) {
+      delete m_ready[i];
+    }
+  }
+
+  MeshingService(const MeshingService &) = delete;
+  MeshingService &operator=(const MeshingService &) = delete;
+
+  // Leaves a hardware thread each for the render thread and the world's loader.
+  static size_t DefaultWorkerCount() { return std::max(std::thread::hardware_concurrency(), 3u) - 2; }
+
+  void Submit(ChunkSnapshot snapshot, const ChunkBorders &borders, uint32_t priority) {
+    ChunkPos pos = snapshot.pos;
+    uint64_t ticket = ++m_next_ticket;
+    uint64_t &current = m_tickets[pos];
+    m_pending += current == 0;
+    current = ticket;
+
+    {
+      std::lock_guard lock{m_mutex};
+      m_queued[pos] = ticket;
+      m_jobs.push_back({priority, ticket, std::move(snapshot), borders});
+      std::push_heap(m_jobs.begin(), m_jobs.end());
+    }
+    m_wake.notify_one();
+  }
+
+  // Also forgets the chunk, for when it was unloaded.
+  void Cancel(ChunkPos pos) {
+    auto it = m_tickets.find(pos);
+    if (it == m_tickets.end()) {
+      return;
+    }
+    m_pending -= it->second != 0;
+    m_tickets.erase(it);
+
+    std::lock_guard lock{m_mutex};
+    m_queued.erase(pos);
+  }
+
+  void CancelAll() {
+    m_tickets.clear();
+    m_pending = 0;
+
+    std::lock_guard lock{m_mutex};
+    m_queued.clear();
+  }
+
+  // Calls fn(pos, const ChunkMesh &) for up to `max_results` finished meshes that are still current, oldest first. The
+  // mesh is only valid during the call. Results over the limit are kept for the next call, so a burst of finished jobs
+  // is spread over several frames.
+  template <typename F> void Drain(size_t max_results, F &&fn) {
+    // The list is pushed to at the front, so it comes out newest first.
+    Result *list = m_results.exchange(nullptr, std::memory_order_acquire);
+    size_t first = m_ready.size();
+    for (; list; list = list->next) {
+      m_ready.push_back(list);
+    }
+    std::reverse(m_ready.begin() + first, m_ready.end());
+
+    for (; m_ready_head < m_ready.size() && max_results > 0; ++m_ready_head) {
+      Result *result = m_ready[m_ready_head];
+      auto it = m_tickets.find(result->pos);
+      if (it != m_tickets.end() && it->second == result->ticket) {
+        it->second = 0;
+        m_pending -= 1;
+        fn(result->pos, std::as_const(result->mesh));
+        max_results -= 1;
+      }
+
+      Push(m_free, result);
+    }
+
+    if (m_ready_head == m_ready.size()) {
+      m_ready.clear();
+      m_ready_head = 0;
+    }
+  }
+
+  // Jobs submitted whose results haven't been handed out yet.
+  size_t GetPendingCount() const { return m_pending; }
+
+private:
+  struct Job {
+    uint32_t priority;
+    uint64_t ticket;
+    ChunkSnapshot snapshot;
+    ChunkBorders borders;
+
+    bool operator<(const Job &other) const {
+      // The heap pops the largest element.
+      return priority != other.priority ? priority > other.priority : ticket > other.ticket;
+    }
+  };
+
+  struct Result {
+    ChunkPos pos{};
+    uint64_t ticket = 0;
+    ChunkMesh mesh;
+    Result *next = nullptr;
+  };
+
+  void WorkerLoop() {
+    std::unique_lock lock{m_mutex};
+    while (true) {
+      m_wake.wait(lock, [this] { return m_stop || !m_jobs.empty(); });
+      if (m_stop) {
+        return;
+      }
+
+      std::pop_heap(m_jobs.begin(), m_jobs.end());
+      Job job = std::move(m_jobs.back());
+      m_jobs.pop_back();
+
+      // Superseded or cancelled since it was queued.
+      auto it = m_queued.find(job.snapshot.pos);
+      if (it == m_queued.end() || it->second != job.ticket) {
+        continue;
+      }
+      it->second = 0;
+
+      if (m_spare.empty()) {
+        for (Result *result = m_free.exchange(nullptr, std::memory_order_acquire); result; result = result->next) {
+          m_spare.push_back(result);
+        }
+      }
+      Result *result = m_spare.empty() ? new Result{} : m_spare.back();
+      if (!m_spare.empty()) {
+        m_spare.pop_back();
+      }
+
+      lock.unlock();
+      Run(std::move(job), *result);
+      Push(m_results, result);
+      lock.lock();
+    }
+  }
+
+  // Takes the job by value, so its references to the chunk's sections are dropped as soon as the mesh is done.
+  void Run(Job job, Result &result) {
+    result.pos = job.snapshot.pos;
+    result.ticket = job.ticket;
+
+    const uint64_t key = m_cache ? GetMeshKey(job.snapshot, job.borders) : 0;
+    if (m_cache && m_cache->Load(key, result.mesh)) {
+      return;
+    }
+
+    ChunkMesher &mesher = ChunkMesher::GetThreadLocal();
+    mesher.Mesh(job.snapshot, job.borders);
+    mesher.Write(result.mesh);
+    if (m_cache) {
+      m_cache->Store(key, result.mesh);
+    }
+  }
+
+  static void Push(std::atomic<Result *> &list, Result *result) {
+    result->next = list.load(std::memory_order_relaxed);
+    while (!list.compare_exchange_weak(result->next, result, std::memory_order_release, std::memory_order_relaxed)) {
+    }
+  }
+
+private:
+  MeshCache *m_cache;
+  std::vector<std::thread> m_threads;
+
+  // Shared with the workers.
+  std::mutex m_mutex;
+  std::condition_variable m_wake;
+  bool m_stop = false;
+  // Max-heap, see Job::operator<().
+  std::vector<Job> m_jobs;
+  // Ticket of the job that should run for each chunk, 0 when none is queued. Entries are kept until the chunk is
+  // cancelled, so remeshing it doesn't allocate map nodes.
+  std::unordered_map<ChunkPos, uint64_t, ChunkPosHash> m_queued;
+  // Results to reuse, refilled from m_free.
+  std::vector<Result *> m_spare;
+
+  // Finished meshes, pushed by the workers without locking.
+  std::atomic<Result *> m_results = nullptr;
+  // Results that were handed out, pushed back by Drain() without locking.
+  std::atomic<Result *> m_free = nullptr;
+
+  // Only touched by the submitting thread.
+  uint64_t m_next_ticket = 0;
+  // Ticket of the job whose result is still wanted for each chunk, 0 once it was handed out. Kept like m_queued.
+  std::unordered_map<ChunkPos, uint64_t, ChunkPosHash> m_tickets;
+  size_t m_pending = 0;
+  // Collected from m_results but not handed out yet, from m_ready_head on.
+  std::vector<Result *> m_ready;
+  size_t m_ready_head = 0;
+};
+} // namespace craft::vk
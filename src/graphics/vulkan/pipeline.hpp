@@ -117,9 +117,10 @@ struct GraphicsPipelineBuilder {
     depth_stencil_state.minDepthBounds = 0.0f;
   }
 
-  FORCE_INLINE void EnableDepthTest() {
+  // Without `write`, geometry is still hidden behind what's in the depth buffer but doesn't hide anything itself.
+  FORCE_INLINE void EnableDepthTest(bool write = true) {
     depth_stencil_state.depthTestEnable = VK_TRUE;
-    depth_stencil_state.depthWriteEnable = VK_TRUE;
+    depth_stencil_state.depthWriteEnable = write ? VK_TRUE : VK_FALSE;
     depth_stencil_state.depthCompareOp = VK_COMPARE_OP_LESS;
     depth_stencil_state.depthBoundsTestEnable = VK_FALSE;
     depth_stencil_state.stencilTestEnable = VK_FALSE;
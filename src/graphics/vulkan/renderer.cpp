@@ -2,8 +2,10 @@
 
 #include <algorithm>
 #include <array>
+#include <cmath>
 #include <execution>
 #include <iostream>
+#include <numeric>
 #include <thread>
 #include <vector>
 
@@ -16,6 +18,7 @@
 #include "descriptor.hpp"
 #include "device.hpp"
 #include "mesh.hpp"
+#include "mesh_cache.hpp"
 #include "pipeline.hpp"
 #include "swapchain.hpp"
 #include "texture.hpp"
@@ -50,6 +53,12 @@ static VmaAllocator CreateAllocator(Device *device) {
   return allocator;
 }
 
+// Where the chunk's mesh coordinates start in the world.
+static glm::vec3 GetChunkOrigin(ChunkPos pos) {
+  return glm::vec3(pos.x * static_cast<int>(kMaxChunkWidth), pos.y * static_cast<int>(kMaxChunkHeight),
+                   pos.z * static_cast<int>(kMaxChunkDepth));
+}
+
 Renderer::Renderer(std::shared_ptr<Window> window, Camera const &camera, World *world)
     : m_window{window}, m_camera{camera}, m_world{world}, m_instance{},
       m_device{m_instance.GetInstance(), {DeviceExtension{VK_KHR_SWAPCHAIN_EXTENSION_NAME}}, &kDeviceFeatures},
@@ -71,6 +80,11 @@ Renderer::Renderer(std::shared_ptr<Window> window, Camera const &camera, World *
   InitCommands();
   InitSyncStructures();
   InitPipelines();
+
+  // Cached with the world, so opening it again doesn't remesh chunks that haven't changed since.
+  if (std::filesystem::path directory = m_world->GetDirectory(); !directory.empty()) {
+    m_mesh_cache.Open(directory / "meshes.cache");
+  }
   InitDefaultData();
 
   // FIXME: no longer working...
@@ -95,14 +109,19 @@ Renderer::Renderer(std::shared_ptr<Window> window, Camera const &camera, World *
 Renderer::~Renderer() {
   m_device.WaitIdle();
 
-  for (auto &mesh : m_meshes) {
-    // DestroyBuffer(*m_allocator, std::move(mesh.index));
-    DestroyBuffer(*m_allocator, std::move(mesh.vertex));
+  for (auto &[pos, mesh] : m_meshes) {
+    DestroyBuffer(*m_allocator, std::move(mesh.faces));
   }
   m_meshes.clear();
+  for (PendingUpload &upload : m_pending_uploads) {
+    DestroyBuffer(*m_allocator, std::move(upload.staging));
+  }
+  m_pending_uploads.clear();
+  FlushRetiredMeshes(true);
 
   vkDestroyPipelineLayout(m_device.GetDevice(), m_textured_mesh_pipeline_layout, nullptr);
-  vkDestroyPipeline(m_device.GetDevice(), m_textured_mesh_pipeline, nullptr);
+  vkDestroyPipeline(m_device.GetDevice(), m_opaque_mesh_pipeline, nullptr);
+  vkDestroyPipeline(m_device.GetDevice(), m_translucent_mesh_pipeline, nullptr);
 
   vkDestroyDescriptorSetLayout(m_device.GetDevice(), m_textured_mesh_descriptor_layout, nullptr);
   m_dallocator.DestroyPool(m_device.GetDevice());
@@ -121,6 +140,7 @@ void Renderer::Draw() {
 
   VK_CHECK(vkWaitForFences(m_device.GetDevice(), 1, &frame.finished_fence, VK_TRUE, 1000'000'000));
   VK_CHECK(vkResetFences(m_device.GetDevice(), 1, &frame.finished_fence));
+  FlushRetiredMeshes();
 
   bool should_resize = false;
 
@@ -148,6 +168,7 @@ void Renderer::Draw() {
 
   VK_CHECK(vkBeginCommandBuffer(cmd, &cmd_begin_info));
 
+  RecordUploads(cmd);
   TransitionImage(cmd, ImageTransitionBarrier(VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR, VK_ACCESS_2_NONE,
                                               VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
                                               VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
@@ -281,6 +302,38 @@ void Renderer::SubmitNow(std::function<void(VkCommandBuffer)> f) {
   VK_CHECK(vkWaitForFences(m_device.GetDevice(), 1, &m_imm.fence, VK_TRUE, 1000'000'000));
 }
 
+void Renderer::QueueUpload(AllocatedBuffer &&staging, VkBuffer destination, VkDeviceSize size) {
+  m_pending_uploads.push_back({std::move(staging), destination, size});
+}
+
+void Renderer::RecordUploads(VkCommandBuffer cmd) {
+  if (m_pending_uploads.empty()) {
+    return;
+  }
+
+  for (PendingUpload &upload : m_pending_uploads) {
+    VkBufferCopy copy{.size = upload.size};
+    vkCmdCopyBuffer(cmd, upload.staging.buffer, upload.destination, 1, &copy);
+    m_retired_buffers.emplace_back(m_frame_number, upload.staging);
+  }
+  m_pending_uploads.clear();
+
+  // A single barrier covers every copy, the vertex shader reads the faces through their buffer's device address.
+  VkMemoryBarrier2 barrier{
+      .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+      .srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+      .srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+      .dstStageMask = VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT,
+      .dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_READ_BIT,
+  };
+
+  VkDependencyInfo dep_info{VK_STRUCTURE_TYPE_DEPENDENCY_INFO};
+  dep_info.memoryBarrierCount = 1;
+  dep_info.pMemoryBarriers = &barrier;
+
+  vkCmdPipelineBarrier2(cmd, &dep_info);
+}
+
 void Renderer::DrawGeometry(VkCommandBuffer cmd, AllocatedImage &render_target, AllocatedImage &depth_buffer) {
   VkClearValue clear_value{{0.0f, 0.0f, 0.0f, 1.0f}};
   VkRenderingAttachmentInfo color_attachment =
@@ -317,7 +370,6 @@ void Renderer::DrawGeometry(VkCommandBuffer cmd, AllocatedImage &render_target,
   VkRect2D scissor{.extent = m_draw_extent};
   vkCmdSetScissor(cmd, 0, 1, &scissor);
 
-  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_textured_mesh_pipeline);
   vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_textured_mesh_pipeline_layout, 0, 1,
                           &m_textured_mesh_descriptor_set, 0, nullptr);
 
@@ -328,26 +380,34 @@ void Renderer::DrawGeometry(VkCommandBuffer cmd, AllocatedImage &render_target,
       glm::mat4(1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f) *
       m_camera.ViewMatrix();
 
-  {
-    size_t index = 0;
-    for (auto &mesh : m_meshes) {
-      DrawPushConstants push_constants;
-      push_constants.vertex_buffer = mesh.vertex_addr;
-      // Position meshes in a grid with proper spacing (16 units between chunks)
-      push_constants.projection =
-          view_proj *
-          glm::translate(glm::mat4(1.0f), glm::vec3(mesh.chunk->x * kMaxChunkWidth, mesh.chunk->y * kMaxChunkHeight,
-                                                    mesh.chunk->z * kMaxChunkDepth));
+  // Nearest chunks first, so the opaque pass covers as much of the screen as early as possible and the depth test
+  // rejects what's behind before it's shaded.
+  const glm::vec3 eye = m_camera.GetPosition();
+  m_draw_list.clear();
+  for (auto &[pos, mesh] : m_meshes) {
+    const uint32_t directions = GetFacingDirections(pos, eye);
+    if (directions == 0) {
+      continue;
+    }
 
-      vkCmdPushConstants(cmd, m_textured_mesh_pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(DrawPushConstants),
-                         &push_constants);
+    const glm::vec3 origin = GetChunkOrigin(pos);
+    const glm::vec3 offset = origin + glm::vec3(kMaxChunkWidth, kMaxChunkHeight, kMaxChunkDepth) * 0.5f - eye;
+    m_draw_list.push_back({glm::dot(offset, offset), directions, &mesh});
+  }
+  std::sort(m_draw_list.begin(), m_draw_list.end(),
+            [](const ChunkDraw &a, const ChunkDraw &b) { return a.distance < b.distance; });
 
-      vkCmdBindIndexBuffer(cmd, mesh.vertex.buffer, mesh.vertex_size, VK_INDEX_TYPE_UINT32);
-      vkCmdDrawIndexed(cmd, mesh.index_size / 4, 1, 0, 0, 0);
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_opaque_mesh_pipeline);
+  for (const ChunkDraw &draw : m_draw_list) {
+    DrawChunk(cmd, view_proj, draw, MeshPass::Opaque);
+  }
 
-      index += 1;
-    }
+  // Translucent faces blend with whatever is behind them, so that has to be drawn first: farthest chunks first.
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_translucent_mesh_pipeline);
+  for (auto it = m_draw_list.rbegin(); it != m_draw_list.rend(); ++it) {
+    DrawChunk(cmd, view_proj, *it, MeshPass::Translucent);
   }
+
   // FIXME: This is a temporary hack to draw the crosshair
   // {
   //   DrawPushConstants push_constants;
@@ -366,6 +426,51 @@ void Renderer::DrawGeometry(VkCommandBuffer cmd, AllocatedImage &render_target,
   vkCmdEndRendering(cmd);
 }
 
+void Renderer::DrawChunk(VkCommandBuffer cmd, const glm::mat4 &view_proj, const ChunkDraw &draw, MeshPass pass) {
+  const MeshBuffers &mesh = *draw.mesh;
+  const uint32_t(&counts)[kMeshFaceCount] = mesh.direction_counts[static_cast<int>(pass)];
+
+  uint32_t visible = 0;
+  for (int face = 0; face < kMeshFaceCount; ++face) {
+    visible += (draw.directions & (1u << face)) ? counts[face] : 0;
+  }
+  if (visible == 0) {
+    return;
+  }
+
+  DrawPushConstants push_constants;
+  push_constants.face_buffer = mesh.faces_addr;
+  push_constants.projection = view_proj * glm::translate(glm::mat4(1.0f), GetChunkOrigin(mesh.pos));
+
+  vkCmdPushConstants(cmd, m_textured_mesh_pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(DrawPushConstants),
+                     &push_constants);
+
+  // The pass's faces start after those of the passes before it. The faces of each direction are stored together, the
+  // ones turned away from the camera are left out of the draws altogether; neighboring directions that are both drawn
+  // share a draw.
+  uint32_t first = 0;
+  for (int i = 0; i < static_cast<int>(pass); ++i) {
+    first = std::accumulate(std::begin(mesh.direction_counts[i]), std::end(mesh.direction_counts[i]), first);
+  }
+
+  uint32_t count = 0;
+  for (int face = 0; face < kMeshFaceCount; ++face) {
+    if (draw.directions & (1u << face)) {
+      count += counts[face];
+      continue;
+    }
+
+    if (count > 0) {
+      vkCmdDraw(cmd, count * 6, 1, first * 6, 0);
+    }
+    first += count + counts[face];
+    count = 0;
+  }
+  if (count > 0) {
+    vkCmdDraw(cmd, count * 6, 1, first * 6, 0);
+  }
+}
+
 void Renderer::InitTexturedMeshPipeline() {
   auto vertex = LoadShaderModule("./shaders/textured_mesh.vert.spv", m_device.GetDevice());
   auto fragment = LoadShaderModule("./shaders/textured_mesh.frag.spv", m_device.GetDevice());
@@ -396,12 +501,18 @@ void Renderer::InitTexturedMeshPipeline() {
   builder.SetPolygonMode(VK_POLYGON_MODE_FILL);
   builder.SetCullMode(VK_CULL_MODE_FRONT_BIT, VK_FRONT_FACE_COUNTER_CLOCKWISE);
   builder.DisableMSAA();
-  builder.EnableAlphaBlending();
+  builder.DisableBlending();
   builder.EnableDepthTest();
 
   builder.SetColorAttachmentFormat(m_frames[0].render_target.format);
 
-  m_textured_mesh_pipeline = builder.Build(m_device.GetDevice());
+  m_opaque_mesh_pipeline = builder.Build(m_device.GetDevice());
+
+  // Translucent faces are drawn last, they don't write depth so ones further back still show through the nearer ones.
+  builder.EnableAlphaBlending();
+  builder.EnableDepthTest(false);
+
+  m_translucent_mesh_pipeline = builder.Build(m_device.GetDevice());
 
   vkDestroyShaderModule(m_device.GetDevice(), *vertex, nullptr);
   vkDestroyShaderModule(m_device.GetDevice(), *fragment, nullptr);
@@ -412,19 +523,90 @@ void Renderer::InitTexturedMeshPipeline() {
 }
 
 void Renderer::InitDefaultData() {
-  m_device.WaitIdle();
-  for (auto &mesh : m_meshes) {
-    // DestroyBuffer(*m_allocator, std::move(mesh.index));
-    DestroyBuffer(*m_allocator, std::move(mesh.vertex));
+  // Chunks that are gone lose their mesh right away, the others keep drawing the old one until the new one is ready.
+  m_meshing.CancelAll();
+  for (auto it = m_meshes.begin(); it != m_meshes.end();) {
+    if (m_world->GetChunk(it->first)) {
+      ++it;
+      continue;
+    }
+
+    RetireMesh(std::move(it->second));
+    it = m_meshes.erase(it);
   }
-  m_meshes.clear();
 
-  for (auto &chunk : m_world->GetChunks()) {
-    ChunkMesh mesh = ChunkMesh::GenerateChunkMeshFromChunk(&chunk);
-    auto &mesh_ =
-        m_meshes.emplace_back(UploadMesh(this, m_device.GetDevice(), *m_allocator, mesh.indices, mesh.vertices));
-    mesh_.chunk = &chunk;
+  for (auto &[pos, chunk] : m_world->GetChunks()) {
+    QueueRemesh(pos);
   }
+  m_world->ClearDirtyChunks();
+}
+
+void Renderer::UpdateDirtyChunkMeshes() {
+  for (auto &[pos, sections] : m_world->GetDirtyChunks()) {
+    QueueRemesh(pos);
+  }
+  m_world->ClearDirtyChunks();
+
+  m_meshing.Drain(kMaxMeshUploadsPerFrame, [this](ChunkPos pos, const ChunkMesh &mesh) { ApplyMesh(pos, mesh); });
+}
+
+void Renderer::QueueRemesh(ChunkPos pos) {
+  Chunk *chunk = m_world->GetChunk(pos);
+  if (!chunk) {
+    m_meshing.Cancel(pos);
+    ApplyMesh(pos, {});
+    return;
+  }
+
+  // Chunks that are already on screen changed under the player (an edit, or a neighbor appeared), those go first.
+  // Newly loaded chunks are meshed nearest first.
+  uint32_t priority = MeshingService::kEditPriority;
+  if (!m_meshes.contains(pos)) {
+    glm::vec3 camera = m_camera.GetPosition();
+    int32_t dx = pos.x - static_cast<int32_t>(std::floor(camera.x / kMaxChunkWidth));
+    int32_t dz = pos.z - static_cast<int32_t>(std::floor(camera.z / kMaxChunkDepth));
+    priority = 1 + static_cast<uint32_t>(dx * dx + dz * dz);
+  }
+
+  m_meshing.Submit(chunk->Snapshot(), chunk->GetBorders(), priority);
+}
+
+void Renderer::ApplyMesh(ChunkPos pos, const ChunkMesh &mesh) {
+  auto it = m_meshes.find(pos);
+  if (it != m_meshes.end()) {
+    RetireMesh(std::move(it->second));
+  }
+
+  if (mesh.faces.empty()) {
+    if (it != m_meshes.end()) {
+      m_meshes.erase(it);
+    }
+    return;
+  }
+
+  MeshBuffers buffers = UploadMesh(this, m_device.GetDevice(), *m_allocator, mesh.faces);
+  buffers.pos = pos;
+  std::copy_n(&mesh.direction_counts[0][0], kMeshPassCount * kMeshFaceCount, &buffers.direction_counts[0][0]);
+  if (it != m_meshes.end()) {
+    it->second = buffers;
+  } else {
+    m_meshes.emplace(pos, buffers);
+  }
+}
+
+void Renderer::RetireMesh(MeshBuffers &&mesh) { m_retired_buffers.emplace_back(m_frame_number, mesh.faces); }
+
+void Renderer::FlushRetiredMeshes(bool all) {
+  // Every frame slot has been waited on since a buffer retired `image count` frames ago, so nothing reads it anymore.
+  uint32_t frames_in_flight = m_swapchain.GetImageCount();
+  std::erase_if(m_retired_buffers, [&](auto &retired) {
+    if (!all && m_frame_number - retired.first <= frames_in_flight) {
+      return false;
+    }
+
+    DestroyBuffer(*m_allocator, std::move(retired.second));
+    return true;
+  });
 }
 
 void Renderer::UpdateTexturedMeshDescriptors(std::shared_ptr<Texture> texture) {
@@ -6,6 +6,7 @@
 
 #include <functional>
 #include <memory>
+#include <unordered_map>
 #include <vector>
 
 #include "descriptor.hpp"
@@ -15,6 +16,8 @@
 #include "imgui.hpp"
 #include "instance.hpp"
 #include "mesh.hpp"
+#include "mesh_cache.hpp"
+#include "meshing_service.hpp"
 #include "platform/window.hpp"
 #include "swapchain.hpp"
 #include "util/raii.hpp"
@@ -57,6 +60,10 @@ struct ImmediateSubmit {
 
 class Renderer {
 public:
+  // Finished meshes are handed over a few at a time, so a burst of them doesn't pile its copies (and staging memory)
+  // onto a single frame.
+  static constexpr size_t const kMaxMeshUploadsPerFrame = 16;
+
   Renderer(std::shared_ptr<Window> window, Camera const &camera, World *chunk);
   ~Renderer();
 
@@ -67,8 +74,14 @@ public:
 
   void Draw();
   void SubmitNow(std::function<void(VkCommandBuffer)> f);
+  // Copies `size` bytes of `staging` to `destination` at the start of the next frame, ahead of its draws, and destroys
+  // `staging` once that frame has finished. Unlike SubmitNow(), this never waits for the GPU.
+  void QueueUpload(AllocatedBuffer &&staging, VkBuffer destination, VkDeviceSize size);
 
+  // Remeshes every loaded chunk in the background.
   void InitDefaultData();
+  // Queues the chunks the world marked dirty since the last call for remeshing and uploads meshes that finished.
+  void UpdateDirtyChunkMeshes();
 
 private:
   void InitCommands();
@@ -79,11 +92,22 @@ private:
   void InitTexturedMeshPipeline();
   void UpdateTexturedMeshDescriptors(std::shared_ptr<Texture> texture);
 
+  // Records the queued uploads, with a barrier that makes them visible to the draws after them.
+  void RecordUploads(VkCommandBuffer cmd);
   void DrawBackground(VkCommandBuffer cmd);
   void DrawGeometry(VkCommandBuffer cmd, AllocatedImage &render_target, AllocatedImage &depth_buffer);
+  struct ChunkDraw;
+  // Draws the faces of `pass` of the chunk that can face the camera.
+  void DrawChunk(VkCommandBuffer cmd, const glm::mat4 &view_proj, const ChunkDraw &draw, MeshPass pass);
 
   void ResizeSwapchain();
 
+  void QueueRemesh(ChunkPos pos);
+  // Replaces the chunk's mesh, an empty one just removes it.
+  void ApplyMesh(ChunkPos pos, const ChunkMesh &mesh);
+  void RetireMesh(MeshBuffers &&mesh);
+  void FlushRetiredMeshes(bool all = false);
+
 private:
   std::shared_ptr<Window> m_window;
   Camera const &m_camera;
@@ -117,10 +141,33 @@ private:
   VkDescriptorSetLayout m_textured_mesh_descriptor_layout;
   VkDescriptorSet m_textured_mesh_descriptor_set;
   VkPipelineLayout m_textured_mesh_pipeline_layout;
-  VkPipeline m_textured_mesh_pipeline;
-
-  std::vector<MeshBuffers> m_meshes{};
+  VkPipeline m_opaque_mesh_pipeline;
+  VkPipeline m_translucent_mesh_pipeline;
+
+  std::unordered_map<ChunkPos, MeshBuffers, ChunkPosHash> m_meshes{};
+  // The chunks drawn this frame, nearest first. Kept between frames so it doesn't reallocate.
+  struct ChunkDraw {
+    // Squared, from the camera to the chunk's center.
+    float distance;
+    // See GetFacingDirections().
+    uint32_t directions;
+    const MeshBuffers *mesh;
+  };
+  std::vector<ChunkDraw> m_draw_list;
+  // Replaced meshes may still be read by frames in flight, so they're destroyed only once those have finished. So are
+  // staging buffers, once the frame that copies from them has.
+  std::vector<std::pair<uint32_t, AllocatedBuffer>> m_retired_buffers{};
+  struct PendingUpload {
+    AllocatedBuffer staging;
+    VkBuffer destination;
+    VkDeviceSize size;
+  };
+  // Recorded into the next frame's command buffer, see QueueUpload().
+  std::vector<PendingUpload> m_pending_uploads;
   MeshBuffers m_crosshair_mesh{};
+  // In the world's directory, not opened for a world that isn't saved.
+  MeshCache m_mesh_cache;
+  MeshingService m_meshing{&m_mesh_cache};
 
   ImmediateSubmit m_imm;
   DescriptorAllocator m_dallocator;
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "widget.hpp"
+#include "world/chunk_arena.hpp"
+
+namespace craft {
+class ChunkMemoryWidget : public Widget {
+public:
+  ChunkMemoryWidget() {
+    m_name = "Chunk Memory";
+    m_closable = true;
+  }
+
+  virtual void OnRender(WidgetManager *manager) override {
+    ChunkArenaStats stats = ChunkArena::Get().GetStats();
+
+    ImGui::Text("Reserved: %.2f MiB", stats.GetReservedBytes() / 1024.0f / 1024.0f);
+    RenderPool("Chunks", stats.chunks);
+    for (const auto &pool : stats.section_data) {
+      RenderPool("Section data", pool);
+    }
+  }
+
+private:
+  static void RenderPool(const char *name, const PoolStats &stats) {
+    ImGui::Text("%s (%zu B slots): %zu/%zu used, %zu blocks (%zu huge), occupancy %.1f%%, fragmentation %.1f%%", name,
+                stats.slot_size, stats.used_slots, stats.total_slots, stats.block_count, stats.huge_page_blocks,
+                stats.Occupancy() * 100.0f, stats.Fragmentation() * 100.0f);
+  }
+};
+} // namespace craft
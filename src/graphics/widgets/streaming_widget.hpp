@@ -0,0 +1,39 @@
+#pragma once
+
+#include "widget.hpp"
+#include "world/world.hpp"
+
+namespace craft {
+class StreamingWidget : public Widget {
+public:
+  StreamingWidget(World &world) : m_world{world}, m_settings{world.GetStreamingSettings()} {
+    m_name = "World Streaming";
+    m_closable = true;
+  }
+
+  virtual void OnRender(WidgetManager *manager) override {
+    ImGui::Text("Loaded chunks: %zu", m_world.GetChunks().Size());
+
+    bool changed = ImGui::SliderInt("Load Radius", &m_settings.load_radius, 1, 32);
+    changed |= ImGui::SliderInt("Unload Radius", &m_settings.unload_radius, 2, 40);
+    changed |= ImGui::SliderInt("Loads Per Frame", &m_settings.max_loads_per_update, 1, 64);
+
+    if (changed) {
+      m_world.SetStreamingSettings(m_settings);
+      m_settings = m_world.GetStreamingSettings();
+    }
+
+    GenerationStats stats = m_world.GetGenerationStats();
+    ImGui::Text("Generated chunks: %llu", static_cast<unsigned long long>(stats.chunks));
+    for (int i = 0; i < static_cast<int>(GenerationStage::Count); ++i) {
+      double average = stats.runs[i] ? stats.nanoseconds[i] / 1e6 / stats.runs[i] : 0.0;
+      ImGui::Text("%s: %llu runs, %.3f ms avg", kGenerationStageNames[i],
+                  static_cast<unsigned long long>(stats.runs[i]), average);
+    }
+  }
+
+private:
+  World &m_world;
+  StreamingSettings m_settings;
+};
+} // namespace craft
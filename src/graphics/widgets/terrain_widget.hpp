@@ -1,43 +1,58 @@
 #pragma once
 
+#include <bit>
+#include <cstdint>
+
 #include "imgui.h"
 #include "widget.hpp"
 #include "world/chunk.hpp"
+#include "world/generator.hpp"
 
 #include <FastNoiseLite/FastNoiseLite.h>
 
 namespace craft {
 class TerrainWidget : public Widget {
 public:
-  TerrainWidget(bool &regenerate, FastNoiseLite &noise, bool &regenerate_with_one_block, float &scale_factor,
-                float &max_height, BlockType &block_type, bool &replace)
-      : m_regenerate{regenerate}, m_noise{noise}, m_regenerate_with_one_block{regenerate_with_one_block},
-        m_scale_factor{scale_factor}, m_max_height{max_height}, m_block_type{block_type}, m_replace{replace} {
+  // Edits a copy of `settings`, which is only written back (and `regenerate` set) when the chunk is regenerated, so
+  // nothing generating from them sees a half-edited configuration.
+  TerrainWidget(bool &regenerate, GeneratorSettings &settings, bool &regenerate_with_one_block, BlockType &block_type,
+                bool &replace)
+      : m_regenerate{regenerate}, m_target{settings}, m_settings{settings},
+        m_regenerate_with_one_block{regenerate_with_one_block}, m_block_type{block_type}, m_replace{replace} {
     m_name = "Terrain";
     m_closable = true;
   }
 
   virtual void OnRender(WidgetManager *manager) override {
     static const char *items[6] = {"OpenSimplex2", "OpenSimplex2S", "Cellular", "Perlin", "ValueCubic", "Value"};
-    ImGui::Combo("Noise Type", &m_current_item, items, IM_ARRAYSIZE(items));
+    ImGui::Combo("Noise Type", (int *)&m_settings.noise_type, items, IM_ARRAYSIZE(items));
 
     static const char *fractal_items[] = {
         "None", "FBm", "Ridged", "PingPong", "DomainWarpProgressive", "DomainWarpIndependent"};
-    ImGui::Combo("Fractal Type", (int *)&m_fractal_type, fractal_items, IM_ARRAYSIZE(fractal_items));
+    ImGui::Combo("Fractal Type", (int *)&m_settings.fractal_type, fractal_items, IM_ARRAYSIZE(fractal_items));
 
     // Add other fractal options to it too.
-    ImGui::SliderInt("Fractal Octaves", &m_octaves, 1, 10);
-    m_noise.SetFractalOctaves(m_octaves);
+    ImGui::SliderInt("Fractal Octaves", &m_settings.octaves, 1, 10);
+    ImGui::SliderFloat("Fractal Lacunarity", &m_settings.lacunarity, 0.1f, 5.0f);
+    ImGui::SliderFloat("Fractal Gain", &m_settings.gain, 0.1f, 2.0f);
+
+    ImGui::InputInt("Seed", &m_settings.seed);
+    ImGui::InputFloat("Scale Factor", &m_settings.scale);
+    ImGui::InputFloat("Max Height", &m_settings.max_height);
 
-    ImGui::SliderFloat("Fractal Lacunarity", &m_lacunarity, 0.1f, 5.0f);
-    m_noise.SetFractalLacunarity(m_lacunarity);
+    static const char *shape_items[] = {"Heightmap", "Density (caves and overhangs)"};
+    ImGui::Combo("Terrain Shape", (int *)&m_settings.shape, shape_items, IM_ARRAYSIZE(shape_items));
 
-    ImGui::SliderFloat("Fractal Gain", &m_gain, 0.1f, 2.0f);
-    m_noise.SetFractalGain(m_gain);
+    static const char *spacing_items[] = {"1", "2", "4", "8", "16"};
+    int spacing_index = std::countr_zero(static_cast<uint32_t>(m_settings.sample_spacing));
+    if (ImGui::Combo("Sample Spacing", &spacing_index, spacing_items, IM_ARRAYSIZE(spacing_items))) {
+      m_settings.sample_spacing = 1 << spacing_index;
+    }
+
+    ImGui::SliderInt("Sea Level", &m_settings.surface.sea_level, 0, static_cast<int>(kMaxChunkHeight) - 1);
+    ImGui::SliderInt("Soil Depth", &m_settings.surface.soil_depth, 0, 16);
+    ImGui::SliderFloat("Tree Density", &m_settings.tree_density, 0.0f, 0.1f);
 
-    ImGui::InputInt("Seed", &m_seed);
-    ImGui::InputFloat("Scale Factor", &m_scale_factor);
-    ImGui::InputFloat("Max Height", &m_max_height);
     ImGui::Checkbox("Only generate a single block (only useful for testing if a mesh is drawn successfully)",
                     &m_regenerate_with_one_block);
     ImGui::NewLine();
@@ -50,30 +65,17 @@ public:
     ImGui::Checkbox("Replace Mode", &m_replace);
 
     if (ImGui::Button("Generate Chunk")) {
-      m_noise.SetSeed(m_seed);
-      m_noise.SetNoiseType((FastNoiseLite::NoiseType)m_current_item);
-      m_noise.SetFractalType(m_fractal_type);
-      m_noise.SetFractalOctaves(m_octaves);
-      m_noise.SetFractalLacunarity(m_lacunarity);
-      m_noise.SetFractalGain(m_gain);
+      m_target = m_settings;
       m_regenerate = true;
     }
   }
 
 private:
   bool &m_regenerate;
-  FastNoiseLite &m_noise;
-
-  int m_current_item = rand();
-  FastNoiseLite::FractalType m_fractal_type = FastNoiseLite::FractalType_None;
-  int m_octaves = 3;
-  float m_lacunarity = 2.0f;
-  float m_gain = 0.5f;
+  GeneratorSettings &m_target;
+  GeneratorSettings m_settings;
 
-  int m_seed = 0;
   bool &m_regenerate_with_one_block;
-  float &m_scale_factor;
-  float &m_max_height;
   BlockType &m_block_type;
   bool &m_replace;
 };
@@ -0,0 +1,166 @@
+#include "mapped_file.hpp"
+
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace craft {
+#ifdef _WIN32
+bool MappedFile::Open(const std::filesystem::path &path) {
+  Close();
+
+  HANDLE file = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS,
+                            FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size)) {
+    CloseHandle(file);
+    return false;
+  }
+
+  m_file = file;
+  m_size = static_cast<size_t>(size.QuadPart);
+  return true;
+}
+
+void MappedFile::Close() {
+  Unmap();
+  if (m_file) {
+    CloseHandle(m_file);
+    m_file = nullptr;
+  }
+  m_size = 0;
+}
+
+bool MappedFile::IsOpen() const { return m_file != nullptr; }
+
+std::span<const uint8_t> MappedFile::Map() {
+  if (m_view_size == m_size || !m_file) {
+    return {m_view, m_view_size};
+  }
+
+  Unmap();
+  if (m_size == 0) {
+    return {};
+  }
+
+  m_mapping = CreateFileMappingW(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (!m_mapping) {
+    return {};
+  }
+
+  m_view = static_cast<const uint8_t *>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+  m_view_size = m_view ? m_size : 0;
+  return {m_view, m_view_size};
+}
+
+bool MappedFile::Write(size_t offset, std::span<const uint8_t> data) {
+  OVERLAPPED overlapped{};
+  overlapped.Offset = static_cast<DWORD>(offset);
+  overlapped.OffsetHigh = static_cast<DWORD>(static_cast<uint64_t>(offset) >> 32);
+
+  DWORD written = 0;
+  if (!WriteFile(m_file, data.data(), static_cast<DWORD>(data.size()), &written, &overlapped) ||
+      written != data.size()) {
+    return false;
+  }
+
+  m_size = std::max(m_size, offset + data.size());
+  return true;
+}
+
+void MappedFile::Unmap() {
+  if (m_view) {
+    UnmapViewOfFile(m_view);
+    m_view = nullptr;
+  }
+  if (m_mapping) {
+    CloseHandle(m_mapping);
+    m_mapping = nullptr;
+  }
+  m_view_size = 0;
+}
+#else
+bool MappedFile::Open(const std::filesystem::path &path) {
+  Close();
+
+  int fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return false;
+  }
+
+  m_fd = fd;
+  m_size = static_cast<size_t>(st.st_size);
+  return true;
+}
+
+void MappedFile::Close() {
+  Unmap();
+  if (m_fd >= 0) {
+    close(m_fd);
+    m_fd = -1;
+  }
+  m_size = 0;
+}
+
+bool MappedFile::IsOpen() const { return m_fd >= 0; }
+
+std::span<const uint8_t> MappedFile::Map() {
+  if (m_view_size == m_size || m_fd < 0) {
+    return {m_view, m_view_size};
+  }
+
+  Unmap();
+  if (m_size == 0) {
+    return {};
+  }
+
+  void *view = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, m_fd, 0);
+  if (view == MAP_FAILED) {
+    return {};
+  }
+
+  m_view = static_cast<const uint8_t *>(view);
+  m_view_size = m_size;
+  return {m_view, m_view_size};
+}
+
+bool MappedFile::Write(size_t offset, std::span<const uint8_t> data) {
+  size_t written = 0;
+  while (written < data.size()) {
+    ssize_t result = pwrite(m_fd, data.data() + written, data.size() - written, offset + written);
+    if (result <= 0) {
+      return false;
+    }
+    written += static_cast<size_t>(result);
+  }
+
+  m_size = std::max(m_size, offset + data.size());
+  return true;
+}
+
+void MappedFile::Unmap() {
+  if (m_view) {
+    munmap(const_cast<uint8_t *>(m_view), m_view_size);
+    m_view = nullptr;
+  }
+  m_view_size = 0;
+}
+#endif
+} // namespace craft
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+
+namespace craft {
+// A read-write file whose contents are read through a read-only memory mapping. Writes go through the file handle, the
+// mapping is refreshed lazily by Map() whenever the file has grown past it.
+class MappedFile {
+public:
+  MappedFile() = default;
+  ~MappedFile() { Close(); }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  // Opens `path` for reading and writing, creating it (but not its directories) if it doesn't exist.
+  bool Open(const std::filesystem::path &path);
+  void Close();
+
+  bool IsOpen() const;
+  size_t GetSize() const { return m_size; }
+
+  // Returns a view of the whole file. Empty for an empty file. The view stays valid until the next Map() or Close().
+  std::span<const uint8_t> Map();
+
+  bool Write(size_t offset, std::span<const uint8_t> data);
+
+private:
+  void Unmap();
+
+private:
+#ifdef _WIN32
+  void *m_file = nullptr;
+  void *m_mapping = nullptr;
+#else
+  int m_fd = -1;
+#endif
+
+  const uint8_t *m_view = nullptr;
+  size_t m_view_size = 0;
+  size_t m_size = 0;
+};
+} // namespace craft
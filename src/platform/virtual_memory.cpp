@@ -0,0 +1,67 @@
+#include "virtual_memory.hpp"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace craft {
+PageAllocation AllocatePages(size_t size, bool prefer_huge_pages) {
+  PageAllocation allocation{.size = size};
+
+#ifdef _WIN32
+  if (prefer_huge_pages) {
+    // Requires SeLockMemoryPrivilege, which most users don't have, so this fails more often than not.
+    size_t large_page = GetLargePageMinimum();
+    if (large_page != 0 && size % large_page == 0) {
+      allocation.memory = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+      allocation.huge_pages = allocation.memory != nullptr;
+    }
+  }
+
+  if (!allocation.memory) {
+    allocation.memory = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+  }
+#else
+  if (prefer_huge_pages && size % kHugePageSize == 0) {
+    void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (memory != MAP_FAILED) {
+      allocation.memory = memory;
+      allocation.huge_pages = true;
+    }
+  }
+
+  if (!allocation.memory) {
+    void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory != MAP_FAILED) {
+      allocation.memory = memory;
+#ifdef MADV_HUGEPAGE
+      // No reserved huge pages, but transparent huge pages may still back this range.
+      if (prefer_huge_pages) {
+        madvise(memory, size, MADV_HUGEPAGE);
+      }
+#endif
+    }
+  }
+#endif
+
+  if (!allocation.memory) {
+    allocation.size = 0;
+  }
+
+  return allocation;
+}
+
+void FreePages(PageAllocation allocation) {
+  if (!allocation.memory) {
+    return;
+  }
+
+#ifdef _WIN32
+  VirtualFree(allocation.memory, 0, MEM_RELEASE);
+#else
+  munmap(allocation.memory, allocation.size);
+#endif
+}
+} // namespace craft
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstddef>
+
+namespace craft {
+constexpr size_t const kHugePageSize = 2 * 1024 * 1024;
+
+struct PageAllocation {
+  void *memory = nullptr;
+  size_t size = 0;
+  bool huge_pages = false;
+};
+
+// Reserves and commits `size` bytes of zeroed memory straight from the OS. When `prefer_huge_pages` is set, large pages
+// are tried first and the allocation quietly falls back to regular pages if the OS refuses them.
+PageAllocation AllocatePages(size_t size, bool prefer_huge_pages);
+void FreePages(PageAllocation allocation);
+} // namespace craft
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#include "platform/virtual_memory.hpp"
+
+namespace craft {
+struct PoolStats {
+  size_t slot_size = 0;
+  size_t block_count = 0;
+  size_t huge_page_blocks = 0;
+  size_t total_slots = 0;
+  size_t used_slots = 0;
+  size_t reserved_bytes = 0;
+
+  // Fraction of the reserved slots that are currently handed out.
+  float Occupancy() const { return total_slots ? static_cast<float>(used_slots) / total_slots : 0.0f; }
+
+  // Fraction of the blocks that are only kept alive by scattered free slots, i.e. that could be given back if the live
+  // slots were packed together.
+  float Fragmentation() const {
+    if (block_count == 0) {
+      return 0.0f;
+    }
+
+    size_t slots_per_block = total_slots / block_count;
+    size_t needed_blocks = (used_slots + slots_per_block - 1) / slots_per_block;
+    return static_cast<float>(block_count - needed_blocks) / block_count;
+  }
+};
+
+// Hands out fixed-size slots carved from large page allocations. Freed slots go onto an intrusive free list and are
+// reused before any new memory is requested, so a steady allocate/free pattern never reaches the OS or the general
+// heap. Blocks are only returned when the pool is destroyed.
+class FixedPool {
+public:
+  FixedPool(size_t slot_size, size_t block_size = kHugePageSize, bool prefer_huge_pages = true)
+      : m_slot_size{AlignSlotSize(slot_size)}, m_block_size{std::max(block_size, AlignSlotSize(slot_size))},
+        m_prefer_huge_pages{prefer_huge_pages} {}
+
+  ~FixedPool() {
+    for (auto &block : m_blocks) {
+      FreePages(block);
+    }
+  }
+
+  FixedPool(const FixedPool &) = delete;
+  FixedPool &operator=(const FixedPool &) = delete;
+
+  void *Allocate() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_free_list) {
+      FreeSlot *slot = m_free_list;
+      m_free_list = slot->next;
+      m_used_slots += 1;
+      return slot;
+    }
+
+    if (m_bump == m_bump_end) {
+      PageAllocation block = AllocatePages(m_block_size, m_prefer_huge_pages);
+      if (!block.memory) {
+        throw std::bad_alloc();
+      }
+
+      m_blocks.push_back(block);
+      m_bump = static_cast<char *>(block.memory);
+      m_bump_end = m_bump + (m_block_size / m_slot_size) * m_slot_size;
+    }
+
+    void *slot = m_bump;
+    m_bump += m_slot_size;
+    m_used_slots += 1;
+    return slot;
+  }
+
+  void Free(void *memory) {
+    if (!memory) {
+      return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    FreeSlot *slot = static_cast<FreeSlot *>(memory);
+    slot->next = m_free_list;
+    m_free_list = slot;
+    m_used_slots -= 1;
+  }
+
+  size_t GetSlotSize() const { return m_slot_size; }
+
+  PoolStats GetStats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    PoolStats stats{.slot_size = m_slot_size, .block_count = m_blocks.size(), .used_slots = m_used_slots};
+    stats.total_slots = m_blocks.size() * (m_block_size / m_slot_size);
+    stats.reserved_bytes = m_blocks.size() * m_block_size;
+    stats.huge_page_blocks = std::count_if(m_blocks.begin(), m_blocks.end(), [](auto &b) { return b.huge_pages; });
+    return stats;
+  }
+
+private:
+  struct FreeSlot {
+    FreeSlot *next;
+  };
+
+  // Cache-line aligned slots, so two chunks never share a line.
+  static constexpr size_t AlignSlotSize(size_t size) { return (std::max(size, sizeof(FreeSlot)) + 63) & ~size_t{63}; }
+
+private:
+  mutable std::mutex m_mutex;
+
+  size_t m_slot_size;
+  size_t m_block_size;
+  bool m_prefer_huge_pages;
+
+  std::vector<PageAllocation> m_blocks;
+  FreeSlot *m_free_list = nullptr;
+  char *m_bump = nullptr;
+  char *m_bump_end = nullptr;
+  size_t m_used_slots = 0;
+};
+
+// Stateless allocator for node-based containers. Single-object allocations (the nodes) come from a process-wide
+// FixedPool per type, anything larger (e.g. hash table buckets) goes to the regular heap.
+template <typename T> struct PoolAllocator {
+  using value_type = T;
+
+  PoolAllocator() = default;
+  template <typename U> PoolAllocator(const PoolAllocator<U> &) {}
+
+  T *allocate(size_t n) {
+    if (n == 1) {
+      return static_cast<T *>(GetPool().Allocate());
+    }
+
+    return std::allocator<T>{}.allocate(n);
+  }
+
+  void deallocate(T *memory, size_t n) {
+    if (n == 1) {
+      GetPool().Free(memory);
+    } else {
+      std::allocator<T>{}.deallocate(memory, n);
+    }
+  }
+
+  static FixedPool &GetPool() {
+    static FixedPool pool(sizeof(T), 64 * 1024, false);
+    return pool;
+  }
+
+  template <typename U> bool operator==(const PoolAllocator<U> &) const { return true; }
+};
+} // namespace craft
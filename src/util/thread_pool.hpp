@@ -0,0 +1,130 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace craft {
+// Fixed set of worker threads for data-parallel loops. The thread that calls ParallelFor() works along with them, so a
+// pool with no workers simply runs the loop inline.
+class ThreadPool {
+public:
+  explicit ThreadPool(size_t workers = DefaultWorkerCount()) {
+    for (size_t i = 0; i < workers; ++i) {
+      m_threads.emplace_back([this, worker = i + 1] { WorkerLoop(worker); });
+    }
+  }
+
+  ~ThreadPool() {
+    {
+      std::lock_guard lock{m_mutex};
+      m_stop = true;
+    }
+    m_wake.notify_all();
+
+    for (auto &thread : m_threads) {
+      thread.join();
+    }
+  }
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  // One less than the number of hardware threads, the calling thread makes up the difference.
+  static size_t DefaultWorkerCount() { return std::max(std::thread::hardware_concurrency(), 1u) - 1; }
+
+  // Including the calling thread.
+  size_t GetThreadCount() const { return m_threads.size() + 1; }
+
+  // Calls fn(index, thread) for every index in [0, count) and returns once all of them have finished. `thread` is in
+  // [0, GetThreadCount()) and no two calls running at the same time get the same one, so it can index per-thread
+  // state. Indices are handed out in order, one at a time.
+  template <typename F> void ParallelFor(size_t count, F &&fn) {
+    if (count == 0) {
+      return;
+    }
+
+    if (m_threads.empty() || count == 1) {
+      for (size_t i = 0; i < count; ++i) {
+        fn(i, 0);
+      }
+      return;
+    }
+
+    std::lock_guard submit{m_submit_mutex};
+    const std::function<void(size_t, size_t)> job = std::ref(fn);
+    {
+      std::lock_guard lock{m_mutex};
+      m_job = &job;
+      m_count = count;
+      m_next = 0;
+      m_generation += 1;
+    }
+    m_wake.notify_all();
+
+    RunJob(&job, count, 0);
+
+    std::unique_lock lock{m_mutex};
+    m_done.wait(lock, [this] { return m_active == 0; });
+    m_job = nullptr;
+  }
+
+private:
+  void WorkerLoop(size_t worker) {
+    uint64_t generation = 0;
+    std::unique_lock lock{m_mutex};
+    while (true) {
+      m_wake.wait(lock, [&] { return m_stop || m_generation != generation; });
+      if (m_stop) {
+        return;
+      }
+
+      generation = m_generation;
+      const auto *job = m_job;
+      size_t count = m_count;
+      if (!job) {
+        continue;
+      }
+
+      m_active += 1;
+      lock.unlock();
+      RunJob(job, count, worker);
+      lock.lock();
+
+      if (--m_active == 0) {
+        m_done.notify_all();
+      }
+    }
+  }
+
+  void RunJob(const std::function<void(size_t, size_t)> *job, size_t count, size_t worker) {
+    for (size_t i = m_next.fetch_add(1); i < count; i = m_next.fetch_add(1)) {
+      (*job)(i, worker);
+    }
+  }
+
+private:
+  std::vector<std::thread> m_threads;
+
+  // Serializes ParallelFor() calls from different threads.
+  std::mutex m_submit_mutex;
+
+  std::mutex m_mutex;
+  std::condition_variable m_wake;
+  std::condition_variable m_done;
+  bool m_stop = false;
+
+  // The running loop, null in between. Workers pick it up when the generation changes.
+  const std::function<void(size_t, size_t)> *m_job = nullptr;
+  size_t m_count = 0;
+  uint64_t m_generation = 0;
+  size_t m_active = 0;
+  std::atomic<size_t> m_next = 0;
+};
+} // namespace craft
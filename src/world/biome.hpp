@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+
+#include "world/block.hpp"
+
+namespace craft {
+enum class Biome : uint8_t {
+  Plains,
+  Forest,
+  Rocky,
+  Volcanic,
+  Count,
+};
+
+struct BiomeInfo {
+  const char *name;
+  // Topmost block of a column and the blocks right under it, stone below that.
+  BlockType top;
+  BlockType soil;
+  // Fills the columns below sea level.
+  BlockType fluid;
+  // Multiplies the settings' tree density.
+  float tree_scale;
+};
+
+constexpr BiomeInfo const kBiomes[static_cast<int>(Biome::Count)] = {
+    {"Plains", BlockType::Dirt, BlockType::Dirt, BlockType::Water, 1.0f},
+    {"Forest", BlockType::Dirt, BlockType::Dirt, BlockType::Water, 6.0f},
+    {"Rocky", BlockType::Stone, BlockType::Stone, BlockType::Water, 0.0f},
+    {"Volcanic", BlockType::Stone, BlockType::Stone, BlockType::Lava, 0.0f},
+};
+
+constexpr const BiomeInfo &GetBiomeInfo(Biome biome) { return kBiomes[static_cast<int>(biome)]; }
+
+// Climate values are noise in [-1, 1].
+constexpr Biome BiomeFromClimate(float temperature, float moisture) {
+  if (temperature < -0.3f) {
+    return Biome::Rocky;
+  } else if (temperature > 0.35f && moisture < -0.1f) {
+    return Biome::Volcanic;
+  } else if (moisture > 0.2f) {
+    return Biome::Forest;
+  }
+  return Biome::Plains;
+}
+} // namespace craft
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+
+namespace craft {
+enum class BlockType : uint8_t {
+  Air,
+  Dirt,
+  Lava,
+  Water,
+  Stone,
+  Wood,
+  Count,
+};
+
+// Blocks that are seen through, they're drawn after everything opaque.
+constexpr bool IsTranslucent(BlockType type) { return type == BlockType::Water || type == BlockType::Lava; }
+
+struct Block {
+  BlockType block_type = BlockType::Air;
+};
+} // namespace craft
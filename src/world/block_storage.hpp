@@ -0,0 +1,266 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "util/optimization.hpp"
+#include "world/block.hpp"
+
+namespace craft {
+constexpr size_t const kMaxPaletteSize = static_cast<size_t>(BlockType::Count);
+
+// Palette-compressed block storage. Every voxel stores an index into a small palette of block types, packed into
+// 64-bit words. Bit widths are restricted to 0, 1, 2, 4 and 8 so that an entry never straddles two words and every
+// access is a couple of shifts. A storage with a single palette entry (a uniform volume) has no data at all.
+template <size_t N, typename Allocator = std::allocator<uint64_t>> class PalettedBlockStorage {
+  static_assert(N % 64 == 0, "storage size must be a multiple of 64 voxels");
+
+public:
+  PalettedBlockStorage() { Fill(BlockType::Air); }
+
+  FORCE_INLINE BlockType Get(size_t index) const {
+    if (m_bits == 0) {
+      return m_palette[0];
+    }
+
+    size_t word = index >> (6 - m_bits_log2);
+    size_t shift = (index & ((64 >> m_bits_log2) - 1)) << m_bits_log2;
+    return m_palette[(m_data[word] >> shift) & ((1ULL << m_bits) - 1)];
+  }
+
+  FORCE_INLINE void Set(size_t index, BlockType type) {
+    uint8_t id = GetOrInsertPaletteIndex(type);
+    if (m_bits == 0) {
+      return;
+    }
+
+    size_t word = index >> (6 - m_bits_log2);
+    size_t shift = (index & ((64 >> m_bits_log2) - 1)) << m_bits_log2;
+    uint64_t mask = ((1ULL << m_bits) - 1) << shift;
+    m_data[word] = (m_data[word] & ~mask) | (static_cast<uint64_t>(id) << shift);
+  }
+
+  // Resets the whole volume to a single block type and releases the packed data.
+  void Fill(BlockType type) {
+    m_lookup.fill(kNotInPalette);
+    m_palette[0] = type;
+    m_lookup[static_cast<size_t>(type)] = 0;
+    m_palette_size = 1;
+    m_bits = 0;
+    m_bits_log2 = 0;
+
+    m_data.clear();
+    m_data.shrink_to_fit();
+  }
+
+  // Expands the whole volume into `out`, the bulk path for code that visits most blocks. The voxels are written in
+  // runs of `run` entries, each run starting `stride` blocks after the previous one, which lets a caller unpack
+  // straight into a larger array (e.g. one section of a chunk's columns).
+  void Unpack(Block *out, size_t run = N, size_t stride = N) const {
+    if (m_bits == 0) {
+      for (size_t r = 0; r < N / run; ++r) {
+        std::fill_n(out + r * stride, run, Block{m_palette[0]});
+      }
+      return;
+    }
+
+    const uint64_t mask = (1ULL << m_bits) - 1;
+    for (size_t r = 0; r < N / run; ++r) {
+      Block *dst = out + r * stride;
+      for (size_t i = 0, index = r * run; i < run; ++i, ++index) {
+        size_t word = index >> (6 - m_bits_log2);
+        size_t shift = (index & ((64 >> m_bits_log2) - 1)) << m_bits_log2;
+        dst[i].block_type = m_palette[(m_data[word] >> shift) & mask];
+      }
+    }
+  }
+
+  // Rebuilds the storage from dense blocks laid out like Unpack() writes them, producing the smallest palette that
+  // covers them.
+  void Pack(const Block *in, size_t run = N, size_t stride = N) {
+    m_lookup.fill(kNotInPalette);
+    m_palette_size = 0;
+    for (size_t r = 0; r < N / run; ++r) {
+      const Block *src = in + r * stride;
+      for (size_t i = 0; i < run; ++i) {
+        size_t type = static_cast<size_t>(src[i].block_type);
+        if (m_lookup[type] == kNotInPalette) {
+          m_lookup[type] = m_palette_size;
+          m_palette[m_palette_size++] = src[i].block_type;
+        }
+      }
+    }
+
+    SetBitsPerEntry(BitsForPaletteSize(m_palette_size));
+    m_data.assign(m_bits ? N >> (6 - m_bits_log2) : 0, 0);
+    m_data.shrink_to_fit();
+    if (m_bits == 0) {
+      return;
+    }
+
+    for (size_t r = 0; r < N / run; ++r) {
+      const Block *src = in + r * stride;
+      for (size_t i = 0, index = r * run; i < run; ++i, ++index) {
+        size_t word = index >> (6 - m_bits_log2);
+        size_t shift = (index & ((64 >> m_bits_log2) - 1)) << m_bits_log2;
+        m_data[word] |= static_cast<uint64_t>(m_lookup[static_cast<size_t>(src[i].block_type)]) << shift;
+      }
+    }
+  }
+
+  // Replaces the storage with a palette and packed words as returned by GetPalette() and GetWords(), e.g. read back
+  // from disk. Returns false (leaving the storage untouched) if they don't describe a valid storage.
+  bool Load(std::span<const BlockType> palette, std::span<const uint64_t> words) {
+    if (palette.empty() || palette.size() > kMaxPaletteSize) {
+      return false;
+    }
+
+    std::array<uint8_t, kMaxPaletteSize> lookup;
+    lookup.fill(kNotInPalette);
+    for (size_t i = 0; i < palette.size(); ++i) {
+      size_t type = static_cast<size_t>(palette[i]);
+      if (type >= kMaxPaletteSize || lookup[type] != kNotInPalette) {
+        return false;
+      }
+      lookup[type] = static_cast<uint8_t>(i);
+    }
+
+    const uint8_t bits = BitsForPaletteSize(palette.size());
+    const uint8_t bits_log2 = bits == 8 ? 3 : bits == 4 ? 2 : bits == 2 ? 1 : 0;
+    if (words.size() != (bits ? N >> (6 - bits_log2) : 0)) {
+      return false;
+    }
+
+    // Every entry has to point into the palette, including the unused values of a partially filled bit width.
+    if (bits && palette.size() < (1ULL << bits)) {
+      const uint64_t mask = (1ULL << bits) - 1;
+      for (uint64_t word : words) {
+        for (uint8_t shift = 0; shift < 64; shift += bits) {
+          if (((word >> shift) & mask) >= palette.size()) {
+            return false;
+          }
+        }
+      }
+    }
+
+    std::copy(palette.begin(), palette.end(), m_palette.begin());
+    m_lookup = lookup;
+    m_palette_size = static_cast<uint8_t>(palette.size());
+    SetBitsPerEntry(bits);
+    m_data.assign(words.begin(), words.end());
+    m_data.shrink_to_fit();
+    return true;
+  }
+
+  // Sets bit i of out[r] when entry r * 32 + i isn't air (and, with `opaque`, isn't translucent either), i.e. one
+  // occupancy mask per run of 32 entries.
+  void GetOccupancy(uint32_t *out, bool opaque = false) const {
+    auto is_solid = [&](BlockType type) { return type != BlockType::Air && !(opaque && IsTranslucent(type)); };
+    if (m_bits == 0) {
+      std::fill_n(out, N / 32, is_solid(m_palette[0]) ? ~0u : 0u);
+      return;
+    }
+
+    uint32_t solid = 0;
+    for (size_t i = 0; i < m_palette_size; ++i) {
+      solid |= static_cast<uint32_t>(is_solid(m_palette[i])) << i;
+    }
+
+    const uint64_t mask = (1ULL << m_bits) - 1;
+    for (size_t r = 0; r < N / 32; ++r) {
+      uint32_t occupancy = 0;
+      for (size_t i = 0, index = r * 32; i < 32; ++i, ++index) {
+        size_t word = index >> (6 - m_bits_log2);
+        size_t shift = (index & ((64 >> m_bits_log2) - 1)) << m_bits_log2;
+        occupancy |= ((solid >> ((m_data[word] >> shift) & mask)) & 1) << i;
+      }
+      out[r] = occupancy;
+    }
+  }
+
+  std::span<const BlockType> GetPalette() const { return {m_palette.data(), m_palette_size}; }
+  std::span<const uint64_t> GetWords() const { return m_data; }
+
+  bool IsUniform() const { return m_bits == 0; }
+  BlockType GetUniformType() const { return m_palette[0]; }
+
+  uint8_t GetBitsPerEntry() const { return m_bits; }
+  size_t GetPaletteSize() const { return m_palette_size; }
+  size_t GetMemoryUsage() const { return sizeof(*this) + m_data.capacity() * sizeof(uint64_t); }
+
+private:
+  static constexpr uint8_t const kNotInPalette = 0xFF;
+
+  static constexpr uint8_t BitsForPaletteSize(size_t size) {
+    if (size <= 1) {
+      return 0;
+    } else if (size <= 2) {
+      return 1;
+    } else if (size <= 4) {
+      return 2;
+    } else if (size <= 16) {
+      return 4;
+    }
+
+    return 8;
+  }
+
+  void SetBitsPerEntry(uint8_t bits) {
+    m_bits = bits;
+    m_bits_log2 = bits == 8 ? 3 : bits == 4 ? 2 : bits == 2 ? 1 : 0;
+  }
+
+  FORCE_INLINE uint8_t GetOrInsertPaletteIndex(BlockType type) {
+    uint8_t id = m_lookup[static_cast<size_t>(type)];
+    if (id != kNotInPalette) {
+      return id;
+    }
+
+    id = m_palette_size++;
+    m_palette[id] = type;
+    m_lookup[static_cast<size_t>(type)] = id;
+
+    if (m_palette_size > (1ULL << m_bits)) {
+      Repack(BitsForPaletteSize(m_palette_size));
+    }
+
+    return id;
+  }
+
+  // Widens every entry to `bits`. Palette indices stay the same, so this is a plain re-layout of the words.
+  void Repack(uint8_t bits) {
+    const uint8_t old_bits = m_bits;
+    const uint8_t old_bits_log2 = m_bits_log2;
+    const std::vector<uint64_t, Allocator> old_data = std::move(m_data);
+
+    SetBitsPerEntry(bits);
+    m_data.assign(N >> (6 - m_bits_log2), 0);
+    if (old_bits == 0) {
+      return;
+    }
+
+    const uint64_t old_mask = (1ULL << old_bits) - 1;
+    const size_t old_per_word = 64 >> old_bits_log2;
+    for (size_t i = 0; i < N; ++i) {
+      uint64_t id = (old_data[i / old_per_word] >> ((i % old_per_word) << old_bits_log2)) & old_mask;
+
+      size_t word = i >> (6 - m_bits_log2);
+      size_t shift = (i & ((64 >> m_bits_log2) - 1)) << m_bits_log2;
+      m_data[word] |= id << shift;
+    }
+  }
+
+private:
+  std::array<BlockType, kMaxPaletteSize> m_palette{};
+  std::array<uint8_t, kMaxPaletteSize> m_lookup{};
+  uint8_t m_palette_size = 0;
+  uint8_t m_bits = 0;
+  uint8_t m_bits_log2 = 0;
+  std::vector<uint64_t, Allocator> m_data;
+};
+} // namespace craft
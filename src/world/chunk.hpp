@@ -1,31 +1,342 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <bit>
 #include <cstdint>
+#include <memory>
+#include <utility>
+
+#include "world/block.hpp"
+#include "world/block_storage.hpp"
+#include "util/pool_allocator.hpp"
+#include "world/chunk_arena.hpp"
 
 namespace craft {
-enum class BlockType : uint8_t {
-  Air,
-  Dirt,
-  Lava,
-  Water,
-  Stone,
-  Wood,
-  Count,
+constexpr size_t const kMaxChunkDepth = 32;
+constexpr size_t const kMaxChunkWidth = 32;
+constexpr size_t const kMaxChunkHeight = 64;
+constexpr size_t const kChunkVolume = kMaxChunkDepth * kMaxChunkWidth * kMaxChunkHeight;
+
+// Chunks are split vertically into cubic sections. A section holding a single block type (usually air or stone)
+// collapses to just its palette entry.
+constexpr size_t const kSectionSize = kMaxChunkWidth;
+constexpr size_t const kSectionVolume = kSectionSize * kSectionSize * kSectionSize;
+constexpr size_t const kSectionsPerChunk = kMaxChunkHeight / kSectionSize;
+static_assert(kMaxChunkDepth == kSectionSize && kMaxChunkHeight % kSectionSize == 0);
+static_assert(kMaxChunkHeight == 64, "column occupancy masks are a single uint64_t per column");
+
+using ChunkSection = PalettedBlockStorage<kSectionVolume, SectionAllocator<uint64_t>>;
+
+// Dense, unpacked view of a chunk. Only used as scratch space by the generator.
+using ChunkBlocks = Block[kMaxChunkDepth][kMaxChunkWidth][kMaxChunkHeight];
+
+// Chunks stack vertically, so the world can be taller than a single chunk. Chunk layers are 0 up to this.
+constexpr int const kWorldHeightInChunks = 1;
+
+// Chunk coordinates, in chunks (not blocks).
+struct ChunkPos {
+  int32_t x, y, z;
+
+  bool operator==(const ChunkPos &) const = default;
 };
 
-struct Block {
-  BlockType block_type = BlockType::Air;
+// World block coordinates.
+struct BlockPos {
+  int32_t x, y, z;
+
+  bool operator==(const BlockPos &) const = default;
 };
 
-constexpr size_t const kMaxChunkDepth = 32;
-constexpr size_t const kMaxChunkWidth = 32;
-constexpr size_t const kMaxChunkHeight = 64;
+constexpr int32_t FloorDiv(int32_t value, int32_t divisor) {
+  return value / divisor - ((value % divisor) != 0 && ((value < 0) != (divisor < 0)));
+}
+
+constexpr int32_t FloorMod(int32_t value, int32_t divisor) { return value - FloorDiv(value, divisor) * divisor; }
+
+constexpr ChunkPos ChunkPosFromBlock(BlockPos pos) {
+  return {FloorDiv(pos.x, static_cast<int32_t>(kMaxChunkWidth)), FloorDiv(pos.y, static_cast<int32_t>(kMaxChunkHeight)),
+          FloorDiv(pos.z, static_cast<int32_t>(kMaxChunkDepth))};
+}
+
+// Same order as the mesh faces, so a face direction can be used directly to index a chunk's neighbors.
+enum class ChunkNeighbor { Front, Back, Left, Right, Top, Bottom, Count };
+
+constexpr ChunkPos const kChunkNeighborOffsets[static_cast<int>(ChunkNeighbor::Count)] = {
+    {0, 0, 1}, {0, 0, -1}, {-1, 0, 0}, {1, 0, 0}, {0, 1, 0}, {0, -1, 0},
+};
+
+constexpr ChunkNeighbor OppositeNeighbor(ChunkNeighbor neighbor) {
+  return static_cast<ChunkNeighbor>(static_cast<int>(neighbor) ^ 1);
+}
+
+struct ColumnMasks {
+  uint64_t masks[kMaxChunkDepth][kMaxChunkWidth] = {};
+  // Like `masks`, but only the blocks that can't be seen through, i.e. without the translucent ones.
+  uint64_t opaque[kMaxChunkDepth][kMaxChunkWidth] = {};
+};
+
+// Occupancy of the blocks just outside a chunk, which the mesher culls border faces against. Copied out of the
+// neighbors, so it can travel with a snapshot. Neighbors that aren't loaded count as air.
+struct ChunkBorders {
+  static_assert(kMaxChunkWidth <= 32, "a row of a neighbor's layer is 32 bits");
+
+  struct Masks {
+    // Column masks of the neighbor columns touching this chunk's sides: front[x] is column (0, x) of the +Z neighbor,
+    // back[x] column (kMaxChunkDepth - 1, x) of the -Z one, left[z] and right[z] likewise for -X and +X.
+    uint64_t front[kMaxChunkWidth] = {};
+    uint64_t back[kMaxChunkWidth] = {};
+    uint64_t left[kMaxChunkDepth] = {};
+    uint64_t right[kMaxChunkDepth] = {};
+    // Bit x of top[z] is set for block (z, x) of the bottom layer of the chunk above, bottom[z] likewise for the top
+    // layer of the chunk below.
+    uint32_t top[kMaxChunkDepth] = {};
+    uint32_t bottom[kMaxChunkDepth] = {};
+  };
+
+  // Blocks that aren't air, see ColumnMasks::masks.
+  Masks occupied;
+  // Blocks that can't be seen through, see ColumnMasks::opaque.
+  Masks opaque;
+};
+
+// Block data of a chunk: reference-counted sections plus column occupancy masks. Data that's shared is never written
+// to, the writer clones whatever it's about to modify first (copy-on-write), so a ChunkSnapshot stays consistent for as
+// long as it's alive, on any thread, without locks. Only the chunk that owns the data writes to it.
+class ChunkData {
+public:
+  ChunkData() {
+    for (auto &section : m_sections) {
+      section = EmptySection();
+    }
+    m_column_masks = EmptyColumnMasks();
+  }
+
+  // Index of a block within its section, sections keep the same Z X Y order as the chunk.
+  static constexpr size_t SectionIndex(int z, int x, int y) {
+    return (static_cast<size_t>(z) * kSectionSize + static_cast<size_t>(x)) * kSectionSize +
+           (static_cast<size_t>(y) % kSectionSize);
+  }
+
+  BlockType Get(int z, int x, int y) const { return m_sections[y / kSectionSize]->Get(SectionIndex(z, x, y)); }
+
+  // Bit y of a column mask is set when the block at (z, x, y) isn't air, so face culling, height queries and raycasts
+  // can work on whole columns with shifts and popcounts.
+  uint64_t GetColumnMask(int z, int x) const { return m_column_masks->masks[z][x]; }
+  // Same, without the translucent blocks.
+  uint64_t GetOpaqueColumnMask(int z, int x) const { return m_column_masks->opaque[z][x]; }
+  const ColumnMasks &GetColumnMasks() const { return *m_column_masks; }
+  bool IsOccupied(int z, int x, int y) const { return (GetColumnMask(z, x) >> y) & 1; }
+
+  // One past the highest non-air block of the column, 0 for an empty column.
+  int GetColumnHeight(int z, int x) const { return std::bit_width(GetColumnMask(z, x)); }
+  int CountColumnBlocks(int z, int x) const { return std::popcount(GetColumnMask(z, x)); }
+
+  const ChunkSection &GetSection(int index) const { return *m_sections[index]; }
+  bool IsSectionEmpty(int index) const {
+    return m_sections[index]->IsUniform() && m_sections[index]->GetUniformType() == BlockType::Air;
+  }
 
-struct Chunk {
+  bool IsEmpty() const {
+    for (int i = 0; i < kSectionsPerChunk; ++i) {
+      if (!IsSectionEmpty(i)) {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  void Unpack(ChunkBlocks &out) const {
+    for (int i = 0; i < kSectionsPerChunk; ++i) {
+      m_sections[i]->Unpack(&out[0][0][i * kSectionSize], kSectionSize, kMaxChunkHeight);
+    }
+  }
+
+  size_t GetMemoryUsage() const {
+    size_t usage = sizeof(*this) + sizeof(ColumnMasks);
+    for (const auto &section : m_sections) {
+      usage += section->GetMemoryUsage();
+    }
+
+    return usage;
+  }
+
+protected:
+  template <typename T, typename... Args> static std::shared_ptr<T> MakeShared(Args &&...args) {
+    return std::allocate_shared<T>(PoolAllocator<T>{}, std::forward<Args>(args)...);
+  }
+
+  // Shared by every chunk until it's first written to.
+  static const std::shared_ptr<ChunkSection> &EmptySection() {
+    static const std::shared_ptr<ChunkSection> section = MakeShared<ChunkSection>();
+    return section;
+  }
+
+  static const std::shared_ptr<ColumnMasks> &EmptyColumnMasks() {
+    static const std::shared_ptr<ColumnMasks> masks = MakeShared<ColumnMasks>();
+    return masks;
+  }
+
+  // Makes `data` safe to write to by cloning it if anything else still references it. Only the owning thread creates
+  // new references, so a use count of one can't grow behind our back.
+  template <typename T> static T &Unshare(std::shared_ptr<T> &data) {
+    if (data.use_count() > 1) {
+      data = MakeShared<T>(*data);
+    } else {
+      AcquireReleasedReferences();
+    }
+
+    return *data;
+  }
+
+  // Like Unshare(), but for data that's about to be overwritten completely, so a shared copy isn't worth cloning.
+  template <typename T> static T &UnshareForOverwrite(std::shared_ptr<T> &data) {
+    if (data.use_count() > 1) {
+      data = MakeShared<T>();
+    } else {
+      AcquireReleasedReferences();
+    }
+
+    return *data;
+  }
+
+  // use_count() is a relaxed load, so seeing a count of one doesn't by itself order the reads a worker made through
+  // its (since dropped) snapshot before our writes. The worker's decrement is a release, this fence pairs with it.
+  static void AcquireReleasedReferences() { std::atomic_thread_fence(std::memory_order_acquire); }
+
+protected:
+  // Bottom to top.
+  std::shared_ptr<ChunkSection> m_sections[kSectionsPerChunk];
+  std::shared_ptr<ColumnMasks> m_column_masks;
+};
+
+// Immutable view of a chunk's blocks at one version. Cheap to take (a few reference count bumps), safe to hand to
+// background jobs; edits made to the chunk afterwards don't show up in it.
+struct ChunkSnapshot : ChunkData {
+  ChunkPos pos{};
+  uint64_t version = 0;
+};
+
+struct Chunk : ChunkData {
   // Z X Y
   int16_t x, z;
   int16_t y;
-  Block blocks[kMaxChunkDepth][kMaxChunkWidth][kMaxChunkHeight];
+
+  // Bumped on every write.
+  uint64_t version = 0;
+
+  // Maintained by ChunkMap, null when the neighbor isn't loaded.
+  Chunk *neighbors[static_cast<int>(ChunkNeighbor::Count)] = {};
+
+  ChunkPos GetPos() const { return {x, y, z}; }
+  Chunk *GetNeighbor(ChunkNeighbor neighbor) const { return neighbors[static_cast<int>(neighbor)]; }
+
+  void Set(int z, int x, int y, BlockType type) {
+    Unshare(m_sections[y / kSectionSize]).Set(SectionIndex(z, x, y), type);
+
+    ColumnMasks &masks = Unshare(m_column_masks);
+    uint64_t bit = 1ULL << y;
+    masks.masks[z][x] = type == BlockType::Air ? masks.masks[z][x] & ~bit : masks.masks[z][x] | bit;
+    masks.opaque[z][x] = type == BlockType::Air || IsTranslucent(type) ? masks.opaque[z][x] & ~bit
+                                                                        : masks.opaque[z][x] | bit;
+    version += 1;
+  }
+
+  void Pack(const ChunkBlocks &in) {
+    for (int i = 0; i < kSectionsPerChunk; ++i) {
+      UnshareForOverwrite(m_sections[i]).Pack(&in[0][0][i * kSectionSize], kSectionSize, kMaxChunkHeight);
+
+      // Uniform air collapses back onto the shared empty section.
+      if (IsSectionEmpty(i)) {
+        m_sections[i] = EmptySection();
+      }
+    }
+
+    ColumnMasks &masks = UnshareForOverwrite(m_column_masks);
+    for (int z = 0; z < kMaxChunkDepth; ++z) {
+      for (int x = 0; x < kMaxChunkWidth; ++x) {
+        uint64_t mask = 0;
+        uint64_t opaque = 0;
+        for (int y = 0; y < kMaxChunkHeight; ++y) {
+          BlockType type = in[z][x][y].block_type;
+          mask |= static_cast<uint64_t>(type != BlockType::Air) << y;
+          opaque |= static_cast<uint64_t>(type != BlockType::Air && !IsTranslucent(type)) << y;
+        }
+        masks.masks[z][x] = mask;
+        masks.opaque[z][x] = opaque;
+      }
+    }
+    version += 1;
+  }
+
+  // Takes over already packed sections (e.g. read from disk), bottom to top, and derives the column masks from them.
+  void Load(ChunkSection (&sections)[kSectionsPerChunk]) {
+    ColumnMasks &masks = UnshareForOverwrite(m_column_masks);
+    uint32_t occupancy[kSectionSize * kSectionSize];
+    uint32_t opaque[kSectionSize * kSectionSize];
+    for (int i = 0; i < kSectionsPerChunk; ++i) {
+      sections[i].GetOccupancy(occupancy);
+      sections[i].GetOccupancy(opaque, true);
+      for (int z = 0; z < kMaxChunkDepth; ++z) {
+        for (int x = 0; x < kMaxChunkWidth; ++x) {
+          uint64_t bits = static_cast<uint64_t>(occupancy[z * kSectionSize + x]) << (i * kSectionSize);
+          uint64_t opaque_bits = static_cast<uint64_t>(opaque[z * kSectionSize + x]) << (i * kSectionSize);
+          masks.masks[z][x] = i == 0 ? bits : masks.masks[z][x] | bits;
+          masks.opaque[z][x] = i == 0 ? opaque_bits : masks.opaque[z][x] | opaque_bits;
+        }
+      }
+
+      bool empty = sections[i].IsUniform() && sections[i].GetUniformType() == BlockType::Air;
+      m_sections[i] = empty ? EmptySection() : MakeShared<ChunkSection>(std::move(sections[i]));
+    }
+    version += 1;
+  }
+
+  ChunkBorders GetBorders() const {
+    ChunkBorders borders;
+    CopyBorders(&ColumnMasks::masks, borders.occupied);
+    CopyBorders(&ColumnMasks::opaque, borders.opaque);
+    return borders;
+  }
+
+private:
+  void CopyBorders(uint64_t (ColumnMasks::*masks)[kMaxChunkDepth][kMaxChunkWidth], ChunkBorders::Masks &out) const {
+    if (const Chunk *front = GetNeighbor(ChunkNeighbor::Front)) {
+      std::copy_n((front->GetColumnMasks().*masks)[0], kMaxChunkWidth, out.front);
+    }
+    if (const Chunk *back = GetNeighbor(ChunkNeighbor::Back)) {
+      std::copy_n((back->GetColumnMasks().*masks)[kMaxChunkDepth - 1], kMaxChunkWidth, out.back);
+    }
+
+    const Chunk *left = GetNeighbor(ChunkNeighbor::Left);
+    const Chunk *right = GetNeighbor(ChunkNeighbor::Right);
+    const Chunk *top = GetNeighbor(ChunkNeighbor::Top);
+    const Chunk *bottom = GetNeighbor(ChunkNeighbor::Bottom);
+    for (int z = 0; z < kMaxChunkDepth; ++z) {
+      out.left[z] = left ? (left->GetColumnMasks().*masks)[z][kMaxChunkWidth - 1] : 0;
+      out.right[z] = right ? (right->GetColumnMasks().*masks)[z][0] : 0;
+
+      for (int x = 0; x < kMaxChunkWidth; ++x) {
+        if (top) {
+          out.top[z] |= static_cast<uint32_t>((top->GetColumnMasks().*masks)[z][x] & 1) << x;
+        }
+        if (bottom) {
+          out.bottom[z] |= static_cast<uint32_t>((bottom->GetColumnMasks().*masks)[z][x] >> (kMaxChunkHeight - 1))
+                           << x;
+        }
+      }
+    }
+  }
+
+public:
+  ChunkSnapshot Snapshot() const {
+    ChunkSnapshot snapshot;
+    static_cast<ChunkData &>(snapshot) = *this;
+    snapshot.pos = GetPos();
+    snapshot.version = version;
+    return snapshot;
+  }
 };
 
 } // namespace craft
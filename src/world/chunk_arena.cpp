@@ -0,0 +1,64 @@
+#include "chunk_arena.hpp"
+
+#include <new>
+
+#include "world/chunk.hpp"
+
+namespace craft {
+static constexpr size_t SectionDataSize(size_t bits) { return kSectionVolume * bits / 8; }
+
+ChunkArena &ChunkArena::Get() {
+  static ChunkArena arena;
+  return arena;
+}
+
+ChunkArena::ChunkArena()
+    : m_chunks{sizeof(Chunk)}, m_section_data{FixedPool{SectionDataSize(1)}, FixedPool{SectionDataSize(2)},
+                                              FixedPool{SectionDataSize(4)}, FixedPool{SectionDataSize(8)}} {}
+
+Chunk *ChunkArena::NewChunk() { return new (m_chunks.Allocate()) Chunk(); }
+
+void ChunkArena::DeleteChunk(Chunk *chunk) {
+  if (!chunk) {
+    return;
+  }
+
+  chunk->~Chunk();
+  m_chunks.Free(chunk);
+}
+
+FixedPool *ChunkArena::FindSectionPool(size_t bytes) {
+  for (auto &pool : m_section_data) {
+    if (pool.GetSlotSize() == bytes) {
+      return &pool;
+    }
+  }
+
+  return nullptr;
+}
+
+void *ChunkArena::AllocateSectionData(size_t bytes) {
+  if (FixedPool *pool = FindSectionPool(bytes)) {
+    return pool->Allocate();
+  }
+
+  return ::operator new(bytes);
+}
+
+void ChunkArena::FreeSectionData(void *data, size_t bytes) {
+  if (FixedPool *pool = FindSectionPool(bytes)) {
+    pool->Free(data);
+  } else {
+    ::operator delete(data);
+  }
+}
+
+ChunkArenaStats ChunkArena::GetStats() const {
+  ChunkArenaStats stats{.chunks = m_chunks.GetStats()};
+  for (size_t i = 0; i < kSectionDataClasses; ++i) {
+    stats.section_data[i] = m_section_data[i].GetStats();
+  }
+
+  return stats;
+}
+} // namespace craft
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <memory>
+
+#include "util/pool_allocator.hpp"
+
+namespace craft {
+struct Chunk;
+
+// Number of packed section sizes (1, 2, 4 and 8 bits per block) that get a dedicated pool.
+constexpr size_t const kSectionDataClasses = 4;
+
+struct ChunkArenaStats {
+  PoolStats chunks;
+  std::array<PoolStats, kSectionDataClasses> section_data;
+
+  size_t GetReservedBytes() const {
+    size_t bytes = chunks.reserved_bytes;
+    for (const auto &stats : section_data) {
+      bytes += stats.reserved_bytes;
+    }
+
+    return bytes;
+  }
+};
+
+// Process-wide home for chunk objects and packed section data. Everything is carved from 2 MiB blocks (huge pages
+// when the OS allows it) and recycled through free lists, so loading and unloading chunks in steady state doesn't touch
+// the general heap.
+class ChunkArena {
+public:
+  static ChunkArena &Get();
+
+  Chunk *NewChunk();
+  void DeleteChunk(Chunk *chunk);
+
+  // Section data of an unexpected size falls back to the regular heap.
+  void *AllocateSectionData(size_t bytes);
+  void FreeSectionData(void *data, size_t bytes);
+
+  ChunkArenaStats GetStats() const;
+
+private:
+  ChunkArena();
+
+  FixedPool *FindSectionPool(size_t bytes);
+
+private:
+  FixedPool m_chunks;
+  std::array<FixedPool, kSectionDataClasses> m_section_data;
+};
+
+struct ChunkDeleter {
+  void operator()(Chunk *chunk) const { ChunkArena::Get().DeleteChunk(chunk); }
+};
+
+using ChunkPtr = std::unique_ptr<Chunk, ChunkDeleter>;
+
+inline ChunkPtr MakeChunk() { return ChunkPtr(ChunkArena::Get().NewChunk()); }
+
+// Routes the packed words of chunk sections through the arena.
+template <typename T> struct SectionAllocator {
+  using value_type = T;
+
+  SectionAllocator() = default;
+  template <typename U> SectionAllocator(const SectionAllocator<U> &) {}
+
+  T *allocate(size_t n) { return static_cast<T *>(ChunkArena::Get().AllocateSectionData(n * sizeof(T))); }
+  void deallocate(T *data, size_t n) { ChunkArena::Get().FreeSectionData(data, n * sizeof(T)); }
+
+  template <typename U> bool operator==(const SectionAllocator<U> &) const { return true; }
+};
+} // namespace craft
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "world/chunk.hpp"
+
+namespace craft {
+static_assert(kChunkVolume <= 65536, "block indices of an edit are 16 bits");
+
+struct BlockEdit {
+  // Z X Y, like the chunk's layout.
+  uint16_t index;
+  BlockType type;
+
+  static constexpr uint16_t Index(int z, int x, int y) {
+    return static_cast<uint16_t>((z * kMaxChunkWidth + x) * kMaxChunkHeight + y);
+  }
+
+  int GetX() const { return (index / kMaxChunkHeight) % kMaxChunkWidth; }
+  int GetY() const { return index % kMaxChunkHeight; }
+  int GetZ() const { return index / (kMaxChunkHeight * kMaxChunkWidth); }
+};
+
+// The blocks of a chunk that were changed after it was generated, the last write to each block wins. Applying them on
+// top of a freshly generated chunk gives back the edited chunk.
+class ChunkEdits {
+public:
+  ChunkEdits() = default;
+  explicit ChunkEdits(std::vector<BlockEdit> edits) : m_edits{std::move(edits)} {}
+
+  void Record(int z, int x, int y, BlockType type) {
+    uint16_t index = BlockEdit::Index(z, x, y);
+    auto it = std::lower_bound(m_edits.begin(), m_edits.end(), index,
+                               [](const BlockEdit &edit, uint16_t index) { return edit.index < index; });
+    if (it != m_edits.end() && it->index == index) {
+      it->type = type;
+    } else {
+      m_edits.insert(it, {index, type});
+    }
+  }
+
+  void Apply(Chunk &chunk) const {
+    for (const BlockEdit &edit : m_edits) {
+      chunk.Set(edit.GetZ(), edit.GetX(), edit.GetY(), edit.type);
+    }
+  }
+
+  bool Contains(uint16_t index) const {
+    auto it = std::lower_bound(m_edits.begin(), m_edits.end(), index,
+                               [](const BlockEdit &edit, uint16_t index) { return edit.index < index; });
+    return it != m_edits.end() && it->index == index;
+  }
+
+  // Sorted by index.
+  std::span<const BlockEdit> GetEdits() const { return m_edits; }
+  bool IsEmpty() const { return m_edits.empty(); }
+
+private:
+  std::vector<BlockEdit> m_edits;
+};
+} // namespace craft
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+
+#include "util/pool_allocator.hpp"
+#include "world/chunk.hpp"
+#include "world/chunk_arena.hpp"
+
+namespace craft {
+struct ChunkPosHash {
+  size_t operator()(const ChunkPos &pos) const {
+    uint64_t h = static_cast<uint32_t>(pos.x) * 0x9E3779B97F4A7C15ULL;
+    h ^= static_cast<uint32_t>(pos.y) * 0xC2B2AE3D27D4EB4FULL;
+    h ^= static_cast<uint32_t>(pos.z) * 0x165667B19E3779F9ULL;
+    return static_cast<size_t>(h ^ (h >> 32));
+  }
+};
+
+// Chunks keyed by their chunk coordinates. Chunks live in ChunkArena slots, so their addresses stay stable for as long
+// as they're in the map, and every chunk caches pointers to its six loaded neighbors. Map nodes come from a pool too,
+// which keeps insert/remove off the general heap once the table has grown to its working size.
+class ChunkMap {
+public:
+  using Storage = std::unordered_map<ChunkPos, ChunkPtr, ChunkPosHash, std::equal_to<ChunkPos>,
+                                     PoolAllocator<std::pair<const ChunkPos, ChunkPtr>>>;
+
+  ChunkMap() = default;
+
+  ChunkMap(const ChunkMap &) = delete;
+  ChunkMap &operator=(const ChunkMap &) = delete;
+
+  Chunk *Find(ChunkPos pos) const {
+    if (auto it = m_chunks.find(pos); it != m_chunks.end()) {
+      return it->second.get();
+    }
+
+    return nullptr;
+  }
+
+  // Returns the chunk at `pos`, creating an empty (all air) one if it doesn't exist yet.
+  Chunk &Insert(ChunkPos pos) {
+    auto [it, inserted] = m_chunks.try_emplace(pos);
+    if (!inserted) {
+      return *it->second;
+    }
+
+    it->second = MakeChunk();
+    Chunk &chunk = *it->second;
+    chunk.x = static_cast<int16_t>(pos.x);
+    chunk.y = static_cast<int16_t>(pos.y);
+    chunk.z = static_cast<int16_t>(pos.z);
+
+    for (int i = 0; i < static_cast<int>(ChunkNeighbor::Count); ++i) {
+      const ChunkPos &offset = kChunkNeighborOffsets[i];
+      Chunk *neighbor = Find({pos.x + offset.x, pos.y + offset.y, pos.z + offset.z});
+      if (neighbor) {
+        chunk.neighbors[i] = neighbor;
+        neighbor->neighbors[static_cast<int>(OppositeNeighbor(static_cast<ChunkNeighbor>(i)))] = &chunk;
+      }
+    }
+
+    return chunk;
+  }
+
+  void Remove(ChunkPos pos) {
+    auto it = m_chunks.find(pos);
+    if (it == m_chunks.end()) {
+      return;
+    }
+
+    Unlink(*it->second);
+    m_chunks.erase(it);
+  }
+
+  void Clear() { m_chunks.clear(); }
+
+  size_t Size() const { return m_chunks.size(); }
+
+  Storage::iterator begin() { return m_chunks.begin(); }
+  Storage::iterator end() { return m_chunks.end(); }
+  Storage::const_iterator begin() const { return m_chunks.begin(); }
+  Storage::const_iterator end() const { return m_chunks.end(); }
+
+private:
+  static void Unlink(Chunk &chunk) {
+    for (int i = 0; i < static_cast<int>(ChunkNeighbor::Count); ++i) {
+      if (Chunk *neighbor = chunk.neighbors[i]) {
+        neighbor->neighbors[static_cast<int>(OppositeNeighbor(static_cast<ChunkNeighbor>(i)))] = nullptr;
+        chunk.neighbors[i] = nullptr;
+      }
+    }
+  }
+
+private:
+  Storage m_chunks;
+};
+} // namespace craft
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdlib>
+
+#include "world/block.hpp"
+#include "world/chunk.hpp"
+#include "world/chunk_edits.hpp"
+
+namespace craft {
+// A block of a feature (e.g. a tree) that lands in another chunk than the one that placed it. Chunks are generated
+// independently, so these are handed to the world, which applies them to the target chunk once it's loaded.
+struct FeatureBlock {
+  ChunkPos target;
+  BlockEdit edit;
+};
+
+// How far a feature can reach out of the column it's placed on, in blocks.
+constexpr int const kMaxFeatureRadius = 2;
+
+// Calls emit(pos, type) for every block of a tree whose trunk stands on `ground`: the trunk, with a crown of branches
+// reaching up to kMaxFeatureRadius blocks out at its top. There's no leaf block, the crown is wood too.
+template <typename F> void PlaceTree(BlockPos ground, int trunk_height, F &&emit) {
+  int top = ground.y + trunk_height;
+  for (int y = ground.y + 1; y <= top; ++y) {
+    emit(BlockPos{ground.x, y, ground.z}, BlockType::Wood);
+  }
+
+  for (int dz = -kMaxFeatureRadius; dz <= kMaxFeatureRadius; ++dz) {
+    for (int dx = -kMaxFeatureRadius; dx <= kMaxFeatureRadius; ++dx) {
+      int distance = std::abs(dx) + std::abs(dz);
+      if (distance == 0 || distance > kMaxFeatureRadius) {
+        continue;
+      }
+
+      emit(BlockPos{ground.x + dx, top, ground.z + dz}, BlockType::Wood);
+      if (distance == 1) {
+        emit(BlockPos{ground.x + dx, top + 1, ground.z + dz}, BlockType::Wood);
+      }
+    }
+  }
+  emit(BlockPos{ground.x, top + 1, ground.z}, BlockType::Wood);
+}
+} // namespace craft
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "world/chunk.hpp"
+#include "world/generator.hpp"
+#include "world/generator_settings.hpp"
+#include "world/heightmap_cache.hpp"
+
+namespace craft {
+enum class GenerationStage { Heightmap, Climate, Surface, Decoration, Blocks, Count };
+
+constexpr const char *const kGenerationStageNames[static_cast<int>(GenerationStage::Count)] = {
+    "Heightmap", "Climate", "Surface", "Decoration", "Blocks",
+};
+
+// How often each stage actually ran (rather than being served from the cache) and the time spent in it.
+struct GenerationStats {
+  uint64_t runs[static_cast<int>(GenerationStage::Count)] = {};
+  uint64_t nanoseconds[static_cast<int>(GenerationStage::Count)] = {};
+  uint64_t chunks = 0;
+};
+
+// Generates chunks like GenerateChunk(), but keeps the output of every heightmap stage of recently generated chunk
+// columns. A stage only reruns when the settings it depends on changed (or its column was pushed out of the cache), so
+// e.g. changing the surface rules regenerates without sampling any noise. Columns are direct-mapped like the heightmap
+// tiles and locked individually, chunks of different columns generate in parallel. Density terrain has no column
+// stages and is timed as a whole under Blocks.
+class GenerationPipeline {
+public:
+  static constexpr int const kColumnCacheSize = HeightmapCache::kHeightmapCacheSize;
+
+  GenerationPipeline() : m_columns{std::make_unique<CachedColumn[]>(kColumnCacheSize * kColumnCacheSize)} {}
+
+  GenerationPipeline(const GenerationPipeline &) = delete;
+  GenerationPipeline &operator=(const GenerationPipeline &) = delete;
+
+  // See BuildChunk() for `features`.
+  void Generate(const GeneratorSettings &settings, ChunkPos pos, Chunk &out,
+                std::vector<FeatureBlock> *features = nullptr) {
+    m_chunks.fetch_add(1, std::memory_order_relaxed);
+
+    if (settings.shape == TerrainShape::Density) {
+      RunStage(GenerationStage::Blocks, [&] { GenerateDensityChunk(settings, pos, out); });
+      return;
+    }
+
+    CachedColumn &column =
+        m_columns[FloorMod(pos.z, kColumnCacheSize) * kColumnCacheSize + FloorMod(pos.x, kColumnCacheSize)];
+    std::lock_guard lock{column.mutex};
+    if (column.x != pos.x || column.z != pos.z) {
+      column.x = pos.x;
+      column.z = pos.z;
+      std::fill(std::begin(column.keys), std::end(column.keys), 0);
+    }
+
+    ColumnStages &stages = column.stages;
+    RunStage(column, GenerationStage::Heightmap, settings.GetShapeKey(),
+             [&] { GenerateHeights(settings, pos.x, pos.z, &m_heightmaps, stages.heights); });
+    RunStage(column, GenerationStage::Climate, settings.GetClimateKey(),
+             [&] { GenerateClimate(settings, pos.x, pos.z, stages.biomes); });
+    RunStage(column, GenerationStage::Surface, settings.GetSurfaceKey(),
+             [&] { GenerateSurface(settings, stages.biomes, stages.surface); });
+    RunStage(column, GenerationStage::Decoration, settings.GetDecorationKey(),
+             [&] { GenerateDecorations(settings, pos.x, pos.z, stages, stages.trees); });
+    RunStage(GenerationStage::Blocks, [&] { BuildChunk(stages, pos, out, features); });
+  }
+
+  GenerationStats GetStats() const {
+    GenerationStats stats;
+    for (int i = 0; i < static_cast<int>(GenerationStage::Count); ++i) {
+      stats.runs[i] = m_runs[i].load(std::memory_order_relaxed);
+      stats.nanoseconds[i] = m_nanoseconds[i].load(std::memory_order_relaxed);
+    }
+    stats.chunks = m_chunks.load(std::memory_order_relaxed);
+    return stats;
+  }
+
+private:
+  // Stages before Blocks, whose output is cached.
+  static constexpr int const kCachedStages = static_cast<int>(GenerationStage::Blocks);
+
+  struct CachedColumn {
+    std::mutex mutex;
+    int32_t x = 0;
+    int32_t z = 0;
+    // Settings key each stage's output was generated with, 0 when it hasn't been.
+    uint64_t keys[kCachedStages] = {};
+    ColumnStages stages;
+  };
+
+  template <typename F> void RunStage(CachedColumn &column, GenerationStage stage, uint64_t key, F &&fn) {
+    uint64_t &cached = column.keys[static_cast<int>(stage)];
+    if (cached != key) {
+      RunStage(stage, fn);
+      cached = key;
+    }
+  }
+
+  template <typename F> void RunStage(GenerationStage stage, F &&fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+
+    m_runs[static_cast<int>(stage)].fetch_add(1, std::memory_order_relaxed);
+    m_nanoseconds[static_cast<int>(stage)].fetch_add(elapsed.count(), std::memory_order_relaxed);
+  }
+
+private:
+  HeightmapCache m_heightmaps;
+  std::unique_ptr<CachedColumn[]> m_columns;
+
+  std::atomic<uint64_t> m_runs[static_cast<int>(GenerationStage::Count)] = {};
+  std::atomic<uint64_t> m_nanoseconds[static_cast<int>(GenerationStage::Count)] = {};
+  std::atomic<uint64_t> m_chunks = 0;
+};
+} // namespace craft
@@ -1,35 +1,462 @@
 #pragma once
 
 #include "chunk.hpp"
+#include "util/error.hpp"
+#include "world/biome.hpp"
+#include "world/features.hpp"
+#include "world/generator_settings.hpp"
+#include "world/heightmap_cache.hpp"
+#include "world/noise_batch.hpp"
 
 #include <FastNoiseLite/FastNoiseLite.h>
 
+#include <algorithm>
+#include <bit>
+#include <cstdint>
 #include <cstring>
+#include <iterator>
+#include <vector>
 
 namespace craft {
-inline void GenerateChunk(bool generate_only_one_block, float max_generated_height, FastNoiseLite &noise, Chunk &out,
-                          float scale = 10.0f, int start_x = 0, int start_z = 0) {
-  memset(out.blocks, 0, sizeof(out.blocks));
+// Block type of solid terrain at world height y.
+constexpr BlockType TerrainBlockType(int y) {
+  if (y > 5) {
+    return BlockType::Dirt;
+  } else if (y > 3) {
+    return BlockType::Water;
+  }
+  return BlockType::Stone;
+}
+
+// Fills a chunk from the noise value of each of its columns, noise[z * kMaxChunkWidth + x] in [-1, 1].
+inline void GenerateChunkFromNoise(const float *noise, float max_generated_height, Chunk &out, int start_y = 0) {
+  // Generate into a dense scratch buffer and pack it in one go, the palette is built from what was actually written.
+  static thread_local ChunkBlocks blocks;
+  memset(blocks, 0, sizeof(blocks));
 
-#pragma omp parallel for
   for (int z = 0; z < kMaxChunkDepth; ++z) {
     for (int x = 0; x < kMaxChunkWidth; ++x) {
-      float height = noise.GetNoise(static_cast<float>(start_x + x) * scale, static_cast<float>(start_z + z) * scale);
+      float height = noise[z * kMaxChunkWidth + x];
       height = (height + 1.0f) / 2.0f;
       height *= max_generated_height;
 
-      uint32_t y_ = (2 + static_cast<uint32_t>(height)) % kMaxChunkHeight;
-      for (uint32_t y = y_; y > 0; --y) {
-        if (y > 5) {
-          out.blocks[z][x][y].block_type = BlockType::Dirt;
-        } else if ((y > 3 && y <= 5)) {
-          out.blocks[z][x][y].block_type = BlockType::Water;
-        } else {
-          out.blocks[z][x][y].block_type = BlockType::Stone;
+      // Column top in world space, clipped to the vertical range this chunk covers. World y = 0 is left empty.
+      int top = std::min(2 + static_cast<int>(height), start_y + static_cast<int>(kMaxChunkHeight) - 1);
+      int bottom = std::max(1, start_y);
+      for (int y = top; y >= bottom; --y) {
+        blocks[z][x][y - start_y].block_type = TerrainBlockType(y);
+      }
+    }
+  }
+
+  out.Pack(blocks);
+}
+
+// Only reads `noise`, so chunks can be generated on several threads at once as long as nothing reconfigures it.
+inline void GenerateChunk(bool generate_only_one_block, float max_generated_height, const FastNoiseLite &noise,
+                          Chunk &out, float scale = 10.0f, int start_x = 0, int start_z = 0, int start_y = 0) {
+  float heights[kMaxChunkDepth * kMaxChunkWidth];
+  for (int z = 0; z < kMaxChunkDepth; ++z) {
+    for (int x = 0; x < kMaxChunkWidth; ++x) {
+      heights[z * kMaxChunkWidth + x] =
+          noise.GetNoise(static_cast<float>(start_x + x) * scale, static_cast<float>(start_z + z) * scale);
+    }
+  }
+
+  GenerateChunkFromNoise(heights, max_generated_height, out, start_y);
+}
+
+// Bilinearly interpolates the column heights of a chunk from the (size + 1) x (size + 1) coarse lattice points around
+// it, lattice[j * (size + 1) + i].
+inline void InterpolateLattice(const float *lattice, int spacing, float *out) {
+  int size = kMaxChunkWidth / spacing;
+  float inv_spacing = 1.0f / static_cast<float>(spacing);
+
+  for (int z = 0; z < kMaxChunkDepth; ++z) {
+    int j = z / spacing;
+    float tz = static_cast<float>(z % spacing) * inv_spacing;
+    const float *row0 = lattice + j * (size + 1);
+    const float *row1 = row0 + size + 1;
+
+    for (int x = 0; x < kMaxChunkWidth; ++x) {
+      int i = x / spacing;
+      float tx = static_cast<float>(x % spacing) * inv_spacing;
+      float height0 = row0[i] + (row0[i + 1] - row0[i]) * tx;
+      float height1 = row1[i] + (row1[i + 1] - row1[i]) * tx;
+      out[z * kMaxChunkWidth + x] = height0 + (height1 - height0) * tz;
+    }
+  }
+}
+
+// Blocks between density lattice points along Y, the horizontal spacing is the settings' sample spacing.
+constexpr int const kDensityVerticalSpacing = 8;
+static_assert(kSectionSize % kDensityVerticalSpacing == 0, "sections start on a lattice point");
+static_assert(kSectionSize == 32, "a section column is one word of 2-bit entries");
+
+// Block types of density terrain, which the generator packs as 2-bit indices.
+constexpr BlockType const kDensityPalette[] = {BlockType::Air, BlockType::Stone, BlockType::Water, BlockType::Dirt};
+
+// Loads a section from one word of 2-bit kDensityPalette indices per column, where `used` has a bit per palette entry
+// found in it. A section of a single type is stored uniform and one of two types at 1 bit, three or more need the 2
+// bits anyway and are loaded as they are.
+inline void LoadDensitySection(const uint64_t (&columns)[kSectionSize * kSectionSize], uint32_t used,
+                               ChunkSection &out) {
+  BlockType palette[2];
+  uint64_t remap[std::size(kDensityPalette)] = {};
+  size_t palette_size = 0;
+  for (size_t id = 0; id < std::size(kDensityPalette) && palette_size < 2; ++id) {
+    if (used & (1u << id)) {
+      remap[id] = palette_size;
+      palette[palette_size++] = kDensityPalette[id];
+    }
+  }
+
+  bool loaded = true;
+  if (std::popcount(used) > 2) {
+    loaded = out.Load(kDensityPalette, columns);
+  } else if (palette_size == 1) {
+    out.Fill(palette[0]);
+  } else {
+    // Two columns share a word at 1 bit.
+    uint64_t words[kSectionVolume / 64] = {};
+    for (size_t column = 0; column < kSectionSize * kSectionSize; ++column) {
+      for (size_t y = 0; y < kSectionSize; ++y) {
+        size_t index = column * kSectionSize + y;
+        words[index / 64] |= remap[(columns[column] >> (2 * y)) & 3] << (index % 64);
+      }
+    }
+    loaded = out.Load(palette, words);
+  }
+
+  if (!loaded) {
+    RuntimeError::Unreachable();
+  }
+}
+
+// Generates a chunk from a 3D density field: the settings' noise plus a bias that falls off with height, so the ground
+// is mostly solid and the sky mostly empty while the noise carves caves and overhangs in between. Density is sampled on
+// a coarse lattice and trilinearly interpolated. Interpolation never leaves the range of the surrounding lattice
+// points, so sections whose points are all on one side of the surface are filled without interpolating (or skipped,
+// when empty), and the others are packed straight into 2 bits per block, one word per section column. Either way a
+// section of one or two block types is stored uniform or at 1 bit per block.
+inline void GenerateDensityChunk(const GeneratorSettings &settings, ChunkPos pos, Chunk &out) {
+  constexpr int kLevels = kMaxChunkHeight / kDensityVerticalSpacing + 1;
+  constexpr int kSectionLevels = kSectionSize / kDensityVerticalSpacing;
+
+  const int spacing = settings.sample_spacing;
+  const int size = kMaxChunkWidth / spacing + 1;
+  const int start_x = pos.x * kMaxChunkWidth;
+  const int start_y = pos.y * kMaxChunkHeight;
+  const int start_z = pos.z * kMaxChunkDepth;
+
+  // The surface sits around the middle of the heightmap generator's range, the bias reaches +-1 (where the noise can
+  // no longer overcome it) max_height blocks above and below it.
+  const float surface = 2.0f + settings.max_height * 0.5f;
+  const float bias_per_block = 1.0f / std::max(settings.max_height, 1.0f);
+
+  FastNoiseLite noise;
+  settings.Apply(noise);
+
+  // lattice[(j * size + i) * kLevels + k], i along X, j along Z and k along Y.
+  float lattice[(kMaxChunkWidth + 1) * (kMaxChunkDepth + 1) * kLevels];
+  for (int j = 0; j < size; ++j) {
+    for (int i = 0; i < size; ++i) {
+      float x = static_cast<float>(start_x + i * spacing) * settings.scale;
+      float z = static_cast<float>(start_z + j * spacing) * settings.scale;
+      for (int k = 0; k < kLevels; ++k) {
+        float y = static_cast<float>(start_y + k * kDensityVerticalSpacing);
+        float density = noise.GetNoise(x, y * settings.scale, z) + (surface - y) * bias_per_block;
+        lattice[(j * size + i) * kLevels + k] = density;
+      }
+    }
+  }
+
+  // Palette indices of the solid blocks of each section height, world y = 0 is left empty like the heightmap does.
+  uint8_t solid_ids[kMaxChunkHeight];
+  for (int y = 0; y < kMaxChunkHeight; ++y) {
+    BlockType type = TerrainBlockType(start_y + y);
+    uint8_t id = static_cast<uint8_t>(std::find(std::begin(kDensityPalette), std::end(kDensityPalette), type) -
+                                      std::begin(kDensityPalette));
+    solid_ids[y] = start_y + y == 0 ? 0 : id;
+  }
+
+  ChunkSection sections[kSectionsPerChunk];
+  uint64_t words[kSectionSize * kSectionSize];
+  for (int section = 0; section < kSectionsPerChunk; ++section) {
+    const int first_level = section * kSectionLevels;
+    const int first_y = section * kSectionSize;
+
+    float min_density = lattice[first_level];
+    float max_density = min_density;
+    for (int column = 0; column < size * size; ++column) {
+      for (int k = first_level; k <= first_level + kSectionLevels; ++k) {
+        min_density = std::min(min_density, lattice[column * kLevels + k]);
+        max_density = std::max(max_density, lattice[column * kLevels + k]);
+      }
+    }
+
+    if (max_density <= 0.0f) {
+      continue;
+    }
+
+    // Bit per kDensityPalette entry found in the section.
+    uint32_t used = 0;
+    if (min_density > 0.0f) {
+      uint64_t word = 0;
+      for (int y = 0; y < kSectionSize; ++y) {
+        word |= static_cast<uint64_t>(solid_ids[first_y + y]) << (2 * y);
+        used |= 1u << solid_ids[first_y + y];
+      }
+      std::fill(std::begin(words), std::end(words), word);
+      LoadDensitySection(words, used, sections[section]);
+      continue;
+    }
+
+    for (int z = 0; z < kMaxChunkDepth; ++z) {
+      int j = z / spacing;
+      float tz = static_cast<float>(z % spacing) / static_cast<float>(spacing);
+      for (int x = 0; x < kMaxChunkWidth; ++x) {
+        int i = x / spacing;
+        float tx = static_cast<float>(x % spacing) / static_cast<float>(spacing);
+
+        // Bilinear density of this column at each lattice level of the section.
+        const float *c00 = &lattice[(j * size + i) * kLevels + first_level];
+        const float *c01 = c00 + kLevels;
+        const float *c10 = c00 + size * kLevels;
+        const float *c11 = c10 + kLevels;
+        float levels[kSectionLevels + 1];
+        for (int k = 0; k <= kSectionLevels; ++k) {
+          float near_z = c00[k] + (c01[k] - c00[k]) * tx;
+          float far_z = c10[k] + (c11[k] - c10[k]) * tx;
+          levels[k] = near_z + (far_z - near_z) * tz;
+        }
+
+        uint64_t word = 0;
+        for (int y = 0; y < kSectionSize; ++y) {
+          int k = y / kDensityVerticalSpacing;
+          float ty = static_cast<float>(y % kDensityVerticalSpacing) * (1.0f / kDensityVerticalSpacing);
+          float density = levels[k] + (levels[k + 1] - levels[k]) * ty;
+          uint8_t id = density > 0.0f ? solid_ids[first_y + y] : 0;
+          word |= static_cast<uint64_t>(id) << (2 * y);
+          used |= 1u << id;
+        }
+
+        words[z * kMaxChunkWidth + x] = word;
+      }
+    }
+
+    LoadDensitySection(words, used, sections[section]);
+  }
+
+  out.Load(sections);
+}
+
+constexpr int const kChunkColumns = kMaxChunkWidth * kMaxChunkDepth;
+
+struct ColumnSurface {
+  BlockType top;
+  BlockType soil;
+  BlockType fluid;
+  uint8_t soil_depth;
+  // World y up to which the blocks above the column are filled with `fluid`.
+  int16_t fluid_level;
+};
+
+// Output of each heightmap generation stage for the columns of one chunk column, indexed z * kMaxChunkWidth + x. Every
+// stage only reads the output of the stages before it, so a stage can be rerun on its own when only the settings it
+// depends on change (see GenerationPipeline).
+struct ColumnStages {
+  // Heightmap: world y of the topmost solid block.
+  int16_t heights[kChunkColumns];
+  // Climate.
+  Biome biomes[kChunkColumns];
+  // Surface: what the column is covered with.
+  ColumnSurface surface[kChunkColumns];
+  // Decoration: trunk height of the tree standing on the column, 0 for none.
+  uint8_t trees[kChunkColumns];
+};
+
+// Samples the heightmap noise of the columns of chunk column (x, z), in [-1, 1]. The noise is evaluated a grid at a
+// time (see NoiseBatch), and with a sample spacing above 1 only on the coarse lattice, whose tiles come from `cache`
+// when one is given. Cached or not, the noise is the same.
+inline void SampleColumnNoise(const GeneratorSettings &settings, int x, int z, HeightmapCache *cache, float *out) {
+  if (settings.sample_spacing <= 1) {
+    NoiseBatch noise{settings};
+    noise.SampleGrid(x * kMaxChunkWidth, z * kMaxChunkDepth, kMaxChunkWidth, kMaxChunkDepth, settings.scale, out);
+    return;
+  }
+
+  int size = GetLatticeSize(settings);
+  int stride = size + 1;
+  float lattice[(kMaxLatticeSize + 1) * (kMaxLatticeSize + 1)];
+
+  if (cache) {
+    // The far row and column of points belong to the neighboring columns' tiles.
+    float tile[kMaxLatticeSize * kMaxLatticeSize];
+    for (int dz = 0; dz <= 1; ++dz) {
+      for (int dx = 0; dx <= 1; ++dx) {
+        cache->GetTile(settings, x + dx, z + dz, tile);
+        for (int j = 0; j < (dz ? 1 : size); ++j) {
+          for (int i = 0; i < (dx ? 1 : size); ++i) {
+            lattice[(dz * size + j) * stride + dx * size + i] = tile[j * size + i];
+          }
         }
       }
     }
+  } else {
+    NoiseBatch noise{settings};
+    noise.SampleGrid(x * size, z * size, stride, stride, settings.scale * static_cast<float>(settings.sample_spacing),
+                     lattice);
   }
+
+  InterpolateLattice(lattice, settings.sample_spacing, out);
+}
+
+// Heightmap stage.
+inline void GenerateHeights(const GeneratorSettings &settings, int x, int z, HeightmapCache *cache, int16_t *out) {
+  float noise[kChunkColumns];
+  SampleColumnNoise(settings, x, z, cache, noise);
+
+  // World y = 0 is left empty, columns start at y = 1.
+  for (int i = 0; i < kChunkColumns; ++i) {
+    out[i] = static_cast<int16_t>(2 + static_cast<int>((noise[i] + 1.0f) / 2.0f * settings.max_height));
+  }
+}
+
+// Climate stage: temperature and moisture vary much slower than the terrain and pick each column's biome.
+inline void GenerateClimate(const GeneratorSettings &settings, int x, int z, Biome *out) {
+  GeneratorSettings climate;
+  climate.noise_type = FastNoiseLite::NoiseType_OpenSimplex2;
+  climate.fractal_type = FastNoiseLite::FractalType_FBm;
+  climate.octaves = 3;
+  climate.frequency = 0.002f;
+
+  float temperature[kChunkColumns];
+  float moisture[kChunkColumns];
+  climate.seed = settings.seed + 1;
+  NoiseBatch{climate}.SampleGrid(x * kMaxChunkWidth, z * kMaxChunkDepth, kMaxChunkWidth, kMaxChunkDepth, 1.0f,
+                                 temperature);
+  climate.seed = settings.seed + 2;
+  NoiseBatch{climate}.SampleGrid(x * kMaxChunkWidth, z * kMaxChunkDepth, kMaxChunkWidth, kMaxChunkDepth, 1.0f,
+                                 moisture);
+
+  for (int i = 0; i < kChunkColumns; ++i) {
+    out[i] = BiomeFromClimate(temperature[i], moisture[i]);
+  }
+}
+
+// Surface stage.
+inline void GenerateSurface(const GeneratorSettings &settings, const Biome *biomes, ColumnSurface *out) {
+  const SurfaceRules &rules = settings.surface;
+  for (int i = 0; i < kChunkColumns; ++i) {
+    const BiomeInfo &biome = GetBiomeInfo(biomes[i]);
+    out[i] = {biome.top, biome.soil, biome.fluid, static_cast<uint8_t>(std::clamp(rules.soil_depth, 0, 255)),
+              static_cast<int16_t>(rules.sea_level)};
+  }
+}
+
+// Same for every run with the same seed, decorations must not depend on the order chunks are generated in.
+constexpr uint32_t HashColumn(int32_t seed, int32_t x, int32_t z) {
+  uint32_t hash = static_cast<uint32_t>(seed) * 0x9E3779B1u ^ static_cast<uint32_t>(x) * 0x85EBCA77u ^
+                  static_cast<uint32_t>(z) * 0xC2B2AE3Du;
+  hash ^= hash >> 15;
+  hash *= 0x2C1B3C6Du;
+  hash ^= hash >> 12;
+  hash *= 0x297A2D39u;
+  return hash ^ (hash >> 15);
+}
+
+// Decoration stage: trees on dry soil, more of them where the biome is lush.
+inline void GenerateDecorations(const GeneratorSettings &settings, int x, int z, const ColumnStages &stages,
+                                uint8_t *out) {
+  for (int i = 0; i < kChunkColumns; ++i) {
+    out[i] = 0;
+
+    const ColumnSurface &surface = stages.surface[i];
+    if (surface.top != BlockType::Dirt || stages.heights[i] < surface.fluid_level) {
+      continue;
+    }
+
+    uint32_t hash = HashColumn(settings.seed, x * kMaxChunkWidth + i % kMaxChunkWidth,
+                               z * kMaxChunkDepth + i / kMaxChunkWidth);
+    float chance = settings.tree_density * GetBiomeInfo(stages.biomes[i]).tree_scale;
+    if (static_cast<float>(hash & 0xFFFF) < chance * 65536.0f) {
+      out[i] = static_cast<uint8_t>(4 + (hash >> 16) % 3);
+    }
+  }
+}
+
+// Writes the blocks of the chunk at `pos` from its column's stage output. Trees are placed by the chunk their trunk
+// starts in; their blocks that land in other chunks go to `features`, or are dropped without it or when they're above
+// or below the world's chunk layers. Features only ever replace air.
+inline void BuildChunk(const ColumnStages &stages, ChunkPos pos, Chunk &out,
+                       std::vector<FeatureBlock> *features = nullptr) {
+  static thread_local ChunkBlocks blocks;
+  memset(blocks, 0, sizeof(blocks));
+
+  const int start_y = pos.y * kMaxChunkHeight;
+  const int end_y = start_y + static_cast<int>(kMaxChunkHeight) - 1;
+  for (int z = 0; z < kMaxChunkDepth; ++z) {
+    for (int x = 0; x < kMaxChunkWidth; ++x) {
+      const int i = z * kMaxChunkWidth + x;
+      const int height = stages.heights[i];
+      const ColumnSurface &surface = stages.surface[i];
+      Block *column = blocks[z][x];
+
+      for (int y = std::max(1, start_y); y <= std::min(height, end_y); ++y) {
+        int depth = height - y;
+        column[y - start_y].block_type = depth == 0                    ? surface.top
+                                         : depth <= surface.soil_depth ? surface.soil
+                                                                       : BlockType::Stone;
+      }
+      for (int y = std::max(height + 1, start_y); y <= std::min<int>(surface.fluid_level, end_y); ++y) {
+        column[y - start_y].block_type = surface.fluid;
+      }
+    }
+  }
+
+  const BlockPos origin{pos.x * static_cast<int>(kMaxChunkWidth), start_y, pos.z * static_cast<int>(kMaxChunkDepth)};
+  for (int i = 0; i < kChunkColumns; ++i) {
+    if (!stages.trees[i] || FloorDiv(stages.heights[i] + 1, static_cast<int32_t>(kMaxChunkHeight)) != pos.y) {
+      continue;
+    }
+
+    const int cx = static_cast<int>(i % kMaxChunkWidth);
+    const int cz = static_cast<int>(i / kMaxChunkWidth);
+    BlockPos ground{origin.x + cx, stages.heights[i], origin.z + cz};
+    PlaceTree(ground, stages.trees[i], [&](BlockPos block, BlockType type) {
+      ChunkPos target = ChunkPosFromBlock(block);
+      int x = FloorMod(block.x, kMaxChunkWidth);
+      int y = FloorMod(block.y, kMaxChunkHeight);
+      int z = FloorMod(block.z, kMaxChunkDepth);
+      if (target == pos) {
+        Block &existing = blocks[z][x][y];
+        existing.block_type = existing.block_type == BlockType::Air ? type : existing.block_type;
+      } else if (features && target.y >= 0 && target.y < kWorldHeightInChunks) {
+        features->push_back({target, {BlockEdit::Index(z, x, y), type}});
+      }
+    });
+  }
+
+  out.Pack(blocks);
+}
+
+// Generates the chunk at `pos` of a world. The output only depends on the settings and the position, so this is safe
+// to call from any thread. Heightmap terrain runs every stage of ColumnStages in order, GenerationPipeline does the
+// same but keeps the stage output around.
+inline void GenerateChunk(const GeneratorSettings &settings, ChunkPos pos, Chunk &out,
+                          HeightmapCache *cache = nullptr, std::vector<FeatureBlock> *features = nullptr) {
+  if (settings.shape == TerrainShape::Density) {
+    GenerateDensityChunk(settings, pos, out);
+    return;
+  }
+
+  static thread_local ColumnStages stages;
+  GenerateHeights(settings, pos.x, pos.z, cache, stages.heights);
+  GenerateClimate(settings, pos.x, pos.z, stages.biomes);
+  GenerateSurface(settings, stages.biomes, stages.surface);
+  GenerateDecorations(settings, pos.x, pos.z, stages, stages.trees);
+  BuildChunk(stages, pos, out, features);
 }
 
 } // namespace craft
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <initializer_list>
+
+#include <FastNoiseLite/FastNoiseLite.h>
+
+namespace craft {
+// Bumped whenever the terrain produced for the same settings changes. Worlds saved as edit deltas only reproduce
+// correctly with the generator version they were saved with.
+constexpr uint32_t const kGeneratorVersion = 4;
+
+// Sample spacings are powers of two, so a coarse lattice point lands on exactly the same noise coordinate as the column
+// under it would.
+constexpr int32_t const kMaxSampleSpacing = 16;
+
+constexpr bool IsValidSampleSpacing(int32_t spacing) {
+  return spacing >= 1 && spacing <= kMaxSampleSpacing && (spacing & (spacing - 1)) == 0;
+}
+
+enum class TerrainShape : int32_t {
+  // One height per column, filled downwards.
+  Heightmap,
+  // Solid wherever a 3D density field is positive, which gives caves, overhangs and floating islands.
+  Density,
+  Count,
+};
+
+// How heightmap columns are covered, applied on top of their biome. Changing these doesn't change the terrain's shape.
+struct SurfaceRules {
+  // Columns below it are filled with their biome's fluid up to here.
+  int32_t sea_level = 5;
+  // Blocks of the biome's soil under its top block.
+  int32_t soil_depth = 3;
+};
+
+constexpr uint64_t HashCombine(uint64_t hash, uint64_t value) { return (hash ^ value) * 0x100000001B3ULL; }
+constexpr uint64_t HashCombine(uint64_t hash, float value) { return HashCombine(hash, uint64_t{std::bit_cast<uint32_t>(value)}); }
+
+// Everything the world generator's output depends on. Saved with a world, so its terrain can be regenerated exactly.
+struct GeneratorSettings {
+  int32_t seed = 0;
+  FastNoiseLite::NoiseType noise_type = FastNoiseLite::NoiseType_OpenSimplex2;
+  FastNoiseLite::FractalType fractal_type = FastNoiseLite::FractalType_FBm;
+  int32_t octaves = 5;
+  float lacunarity = 2.0f;
+  float gain = 0.5f;
+  float frequency = 0.01f;
+  float max_height = 16.0f;
+  float scale = 1.0f;
+  // Columns between noise samples along X and Z, the heights in between are interpolated. 1 samples every column.
+  int32_t sample_spacing = 4;
+  TerrainShape shape = TerrainShape::Heightmap;
+  SurfaceRules surface;
+  // Chance of a tree on a plains column.
+  float tree_density = 0.005f;
+
+  void Apply(FastNoiseLite &noise) const {
+    noise.SetSeed(seed);
+    noise.SetNoiseType(noise_type);
+    noise.SetFractalType(fractal_type);
+    noise.SetFractalOctaves(octaves);
+    noise.SetFractalLacunarity(lacunarity);
+    noise.SetFractalGain(gain);
+    noise.SetFrequency(frequency);
+  }
+
+  // Keys of the settings each generation stage depends on, so cached stage output can be checked against the current
+  // settings cheaply. A stage's key includes the keys of the stages it builds on.
+  uint64_t GetShapeKey() const {
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (int32_t value : {seed, static_cast<int32_t>(noise_type), static_cast<int32_t>(fractal_type), octaves,
+                          sample_spacing, static_cast<int32_t>(shape)}) {
+      hash = HashCombine(hash, static_cast<uint64_t>(static_cast<uint32_t>(value)));
+    }
+    for (float value : {lacunarity, gain, frequency, max_height, scale}) {
+      hash = HashCombine(hash, value);
+    }
+    return hash;
+  }
+
+  uint64_t GetClimateKey() const { return HashCombine(0xCBF29CE484222325ULL, static_cast<uint64_t>(seed) + 1); }
+
+  uint64_t GetSurfaceKey() const {
+    uint64_t hash = HashCombine(GetClimateKey(), static_cast<uint64_t>(surface.sea_level));
+    return HashCombine(hash, static_cast<uint64_t>(surface.soil_depth));
+  }
+
+  uint64_t GetDecorationKey() const {
+    return HashCombine(HashCombine(GetShapeKey(), GetSurfaceKey()), tree_density);
+  }
+};
+} // namespace craft
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "world/chunk.hpp"
+#include "world/generator_settings.hpp"
+#include "world/noise_batch.hpp"
+
+namespace craft {
+static_assert(kMaxChunkWidth == kMaxChunkDepth, "lattice tiles are square");
+
+// Lattice points along a chunk side at the smallest coarse spacing.
+constexpr int const kMaxLatticeSize = kMaxChunkWidth / 2;
+
+inline int GetLatticeSize(const GeneratorSettings &settings) { return kMaxChunkWidth / settings.sample_spacing; }
+
+// Samples the coarse noise lattice points that lie inside chunk column (x, z), out[j * size + i] being the point i
+// spacings along X and j along Z from the column's corner.
+inline void SampleLatticeTile(const GeneratorSettings &settings, int x, int z, float *out) {
+  int size = GetLatticeSize(settings);
+  NoiseBatch noise{settings};
+  noise.SampleGrid(x * size, z * size, size, size, settings.scale * static_cast<float>(settings.sample_spacing), out);
+}
+
+// Lattice tiles shared between chunk generations, so the points on a chunk border are only sampled once for both
+// chunks. Tiles are direct-mapped by their column coordinates, which keeps any kHeightmapCacheSize wide square of
+// columns resident at once; a tile that loses its slot, or was sampled with other settings, is simply sampled again.
+// Safe to use from several threads.
+class HeightmapCache {
+public:
+  static constexpr int const kHeightmapCacheSize = 32;
+
+  HeightmapCache() : m_tiles(kHeightmapCacheSize * kHeightmapCacheSize) {}
+
+  HeightmapCache(const HeightmapCache &) = delete;
+  HeightmapCache &operator=(const HeightmapCache &) = delete;
+
+  // Copies the lattice tile of chunk column (x, z) to `out`, see SampleLatticeTile().
+  void GetTile(const GeneratorSettings &settings, int x, int z, float *out) {
+    int points = GetLatticeSize(settings) * GetLatticeSize(settings);
+    uint64_t key = settings.GetShapeKey();
+    Tile &tile = m_tiles[FloorMod(z, kHeightmapCacheSize) * kHeightmapCacheSize + FloorMod(x, kHeightmapCacheSize)];
+    {
+      std::lock_guard lock{m_mutex};
+      if (tile.key == key && tile.x == x && tile.z == z) {
+        std::copy_n(tile.points, points, out);
+        return;
+      }
+    }
+
+    // Sampled outside the lock. Two threads may end up sampling the same tile, which gives the same points.
+    SampleLatticeTile(settings, x, z, out);
+
+    std::lock_guard lock{m_mutex};
+    tile.x = x;
+    tile.z = z;
+    tile.key = key;
+    std::copy_n(out, points, tile.points);
+  }
+
+private:
+  struct Tile {
+    int32_t x = 0;
+    int32_t z = 0;
+    // Shape key of the settings the points were sampled with, 0 for an empty slot.
+    uint64_t key = 0;
+    float points[kMaxLatticeSize * kMaxLatticeSize];
+  };
+
+  std::mutex m_mutex;
+  std::vector<Tile> m_tiles;
+};
+} // namespace craft
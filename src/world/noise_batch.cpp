@@ -0,0 +1,386 @@
+#include "noise_batch.hpp"
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "util/optimization.hpp"
+
+namespace craft {
+namespace {
+float FractalBounding(const GeneratorSettings &settings) {
+  float gain = settings.gain < 0 ? -settings.gain : settings.gain;
+  float amp = gain;
+  float amp_fractal = 1.0f;
+  for (int i = 1; i < settings.octaves; i++) {
+    amp_fractal += amp;
+    amp *= gain;
+  }
+
+  return 1 / amp_fractal;
+}
+
+#ifdef __AVX2__
+// The vectorized paths below mirror FastNoiseLite's scalar 2D noise functions operation for operation, so they produce
+// the same values (up to FMA contraction). Its weighted strength is always 0 and its ping pong strength always 2 here,
+// GeneratorSettings doesn't expose them.
+
+// FastNoiseLite's gradient table, which it keeps private.
+alignas(64) constexpr float const kGradients2D[256] = {
+    0.130526192220052f, 0.99144486137381f, 0.38268343236509f, 0.923879532511287f, 0.608761429008721f,
+    0.793353340291235f, 0.793353340291235f, 0.608761429008721f, 0.923879532511287f, 0.38268343236509f,
+    0.99144486137381f, 0.130526192220051f, 0.99144486137381f, -0.130526192220051f, 0.923879532511287f,
+    -0.38268343236509f, 0.793353340291235f, -0.60876142900872f, 0.608761429008721f, -0.793353340291235f,
+    0.38268343236509f, -0.923879532511287f, 0.130526192220052f, -0.99144486137381f, -0.130526192220052f,
+    -0.99144486137381f, -0.38268343236509f, -0.923879532511287f, -0.608761429008721f, -0.793353340291235f,
+    -0.793353340291235f, -0.608761429008721f, -0.923879532511287f, -0.38268343236509f, -0.99144486137381f,
+    -0.130526192220052f, -0.99144486137381f, 0.130526192220051f, -0.923879532511287f, 0.38268343236509f,
+    -0.793353340291235f, 0.608761429008721f, -0.608761429008721f, 0.793353340291235f, -0.38268343236509f,
+    0.923879532511287f, -0.130526192220052f, 0.99144486137381f, 0.130526192220052f, 0.99144486137381f,
+    0.38268343236509f, 0.923879532511287f, 0.608761429008721f, 0.793353340291235f, 0.793353340291235f,
+    0.608761429008721f, 0.923879532511287f, 0.38268343236509f, 0.99144486137381f, 0.130526192220051f,
+    0.99144486137381f, -0.130526192220051f, 0.923879532511287f, -0.38268343236509f, 0.793353340291235f,
+    -0.60876142900872f, 0.608761429008721f, -0.793353340291235f, 0.38268343236509f, -0.923879532511287f,
+    0.130526192220052f, -0.99144486137381f, -0.130526192220052f, -0.99144486137381f, -0.38268343236509f,
+    -0.923879532511287f, -0.608761429008721f, -0.793353340291235f, -0.793353340291235f, -0.608761429008721f,
+    -0.923879532511287f, -0.38268343236509f, -0.99144486137381f, -0.130526192220052f, -0.99144486137381f,
+    0.130526192220051f, -0.923879532511287f, 0.38268343236509f, -0.793353340291235f, 0.608761429008721f,
+    -0.608761429008721f, 0.793353340291235f, -0.38268343236509f, 0.923879532511287f, -0.130526192220052f,
+    0.99144486137381f, 0.130526192220052f, 0.99144486137381f, 0.38268343236509f, 0.923879532511287f,
+    0.608761429008721f, 0.793353340291235f, 0.793353340291235f, 0.608761429008721f, 0.923879532511287f,
+    0.38268343236509f, 0.99144486137381f, 0.130526192220051f, 0.99144486137381f, -0.130526192220051f,
+    0.923879532511287f, -0.38268343236509f, 0.793353340291235f, -0.60876142900872f, 0.608761429008721f,
+    -0.793353340291235f, 0.38268343236509f, -0.923879532511287f, 0.130526192220052f, -0.99144486137381f,
+    -0.130526192220052f, -0.99144486137381f, -0.38268343236509f, -0.923879532511287f, -0.608761429008721f,
+    -0.793353340291235f, -0.793353340291235f, -0.608761429008721f, -0.923879532511287f, -0.38268343236509f,
+    -0.99144486137381f, -0.130526192220052f, -0.99144486137381f, 0.130526192220051f, -0.923879532511287f,
+    0.38268343236509f, -0.793353340291235f, 0.608761429008721f, -0.608761429008721f, 0.793353340291235f,
+    -0.38268343236509f, 0.923879532511287f, -0.130526192220052f, 0.99144486137381f, 0.130526192220052f,
+    0.99144486137381f, 0.38268343236509f, 0.923879532511287f, 0.608761429008721f, 0.793353340291235f,
+    0.793353340291235f, 0.608761429008721f, 0.923879532511287f, 0.38268343236509f, 0.99144486137381f,
+    0.130526192220051f, 0.99144486137381f, -0.130526192220051f, 0.923879532511287f, -0.38268343236509f,
+    0.793353340291235f, -0.60876142900872f, 0.608761429008721f, -0.793353340291235f, 0.38268343236509f,
+    -0.923879532511287f, 0.130526192220052f, -0.99144486137381f, -0.130526192220052f, -0.99144486137381f,
+    -0.38268343236509f, -0.923879532511287f, -0.608761429008721f, -0.793353340291235f, -0.793353340291235f,
+    -0.608761429008721f, -0.923879532511287f, -0.38268343236509f, -0.99144486137381f, -0.130526192220052f,
+    -0.99144486137381f, 0.130526192220051f, -0.923879532511287f, 0.38268343236509f, -0.793353340291235f,
+    0.608761429008721f, -0.608761429008721f, 0.793353340291235f, -0.38268343236509f, 0.923879532511287f,
+    -0.130526192220052f, 0.99144486137381f, 0.130526192220052f, 0.99144486137381f, 0.38268343236509f,
+    0.923879532511287f, 0.608761429008721f, 0.793353340291235f, 0.793353340291235f, 0.608761429008721f,
+    0.923879532511287f, 0.38268343236509f, 0.99144486137381f, 0.130526192220051f, 0.99144486137381f,
+    -0.130526192220051f, 0.923879532511287f, -0.38268343236509f, 0.793353340291235f, -0.60876142900872f,
+    0.608761429008721f, -0.793353340291235f, 0.38268343236509f, -0.923879532511287f, 0.130526192220052f,
+    -0.99144486137381f, -0.130526192220052f, -0.99144486137381f, -0.38268343236509f, -0.923879532511287f,
+    -0.608761429008721f, -0.793353340291235f, -0.793353340291235f, -0.608761429008721f, -0.923879532511287f,
+    -0.38268343236509f, -0.99144486137381f, -0.130526192220052f, -0.99144486137381f, 0.130526192220051f,
+    -0.923879532511287f, 0.38268343236509f, -0.793353340291235f, 0.608761429008721f, -0.608761429008721f,
+    0.793353340291235f, -0.38268343236509f, 0.923879532511287f, -0.130526192220052f, 0.99144486137381f,
+    0.38268343236509f, 0.923879532511287f, 0.923879532511287f, 0.38268343236509f, 0.923879532511287f,
+    -0.38268343236509f, 0.38268343236509f, -0.923879532511287f, -0.38268343236509f, -0.923879532511287f,
+    -0.923879532511287f, -0.38268343236509f, -0.923879532511287f, 0.38268343236509f, -0.38268343236509f,
+    0.923879532511287f,
+};
+
+constexpr int const kPrimeX = 501125321;
+constexpr int const kPrimeY = 1136930381;
+
+FORCE_INLINE __m256i FastFloor(__m256 f) {
+  // (int)f, minus one for negative values.
+  __m256i negative = _mm256_castps_si256(_mm256_cmp_ps(f, _mm256_setzero_ps(), _CMP_LT_OQ));
+  return _mm256_add_epi32(_mm256_cvttps_epi32(f), negative);
+}
+
+FORCE_INLINE __m256 Lerp(__m256 a, __m256 b, __m256 t) {
+  return _mm256_add_ps(a, _mm256_mul_ps(t, _mm256_sub_ps(b, a)));
+}
+
+FORCE_INLINE __m256i Hash(__m256i seed, __m256i x_primed, __m256i y_primed) {
+  __m256i hash = _mm256_xor_si256(seed, _mm256_xor_si256(x_primed, y_primed));
+  return _mm256_mullo_epi32(hash, _mm256_set1_epi32(0x27d4eb2d));
+}
+
+FORCE_INLINE __m256 ValCoord(__m256i seed, __m256i x_primed, __m256i y_primed) {
+  __m256i hash = Hash(seed, x_primed, y_primed);
+  hash = _mm256_mullo_epi32(hash, hash);
+  hash = _mm256_xor_si256(hash, _mm256_slli_epi32(hash, 19));
+  return _mm256_mul_ps(_mm256_cvtepi32_ps(hash), _mm256_set1_ps(1 / 2147483648.0f));
+}
+
+FORCE_INLINE __m256 GradCoord(__m256i seed, __m256i x_primed, __m256i y_primed, __m256 xd, __m256 yd) {
+  __m256i hash = Hash(seed, x_primed, y_primed);
+  hash = _mm256_xor_si256(hash, _mm256_srai_epi32(hash, 15));
+  hash = _mm256_and_si256(hash, _mm256_set1_epi32(127 << 1));
+
+  __m256 xg = _mm256_i32gather_ps(kGradients2D, hash, 4);
+  __m256 yg = _mm256_i32gather_ps(kGradients2D + 1, hash, 4);
+  return _mm256_add_ps(_mm256_mul_ps(xd, xg), _mm256_mul_ps(yd, yg));
+}
+
+// Expects coordinates already skewed, like FastNoiseLite does in TransformNoiseCoordinate().
+__m256 SingleSimplex(__m256i seed, __m256 x, __m256 y) {
+  const float SQRT3 = 1.7320508075688772935274463415059f;
+  const float G2 = (3 - SQRT3) / 6;
+
+  __m256i i = FastFloor(x);
+  __m256i j = FastFloor(y);
+  __m256 xi = _mm256_sub_ps(x, _mm256_cvtepi32_ps(i));
+  __m256 yi = _mm256_sub_ps(y, _mm256_cvtepi32_ps(j));
+
+  __m256 t = _mm256_mul_ps(_mm256_add_ps(xi, yi), _mm256_set1_ps(G2));
+  __m256 x0 = _mm256_sub_ps(xi, t);
+  __m256 y0 = _mm256_sub_ps(yi, t);
+
+  i = _mm256_mullo_epi32(i, _mm256_set1_epi32(kPrimeX));
+  j = _mm256_mullo_epi32(j, _mm256_set1_epi32(kPrimeY));
+  const __m256i prime_x = _mm256_set1_epi32(kPrimeX);
+  const __m256i prime_y = _mm256_set1_epi32(kPrimeY);
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 half = _mm256_set1_ps(0.5f);
+
+  __m256 a = _mm256_sub_ps(_mm256_sub_ps(half, _mm256_mul_ps(x0, x0)), _mm256_mul_ps(y0, y0));
+  __m256 a2 = _mm256_mul_ps(a, a);
+  __m256 n0 = _mm256_mul_ps(_mm256_mul_ps(a2, a2), GradCoord(seed, i, j, x0, y0));
+  n0 = _mm256_and_ps(n0, _mm256_cmp_ps(a, zero, _CMP_GT_OQ));
+
+  __m256 c = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps((float)(2 * (1 - 2 * G2) * (1 / G2 - 2))), t),
+                           _mm256_add_ps(_mm256_set1_ps((float)(-2 * (1 - 2 * G2) * (1 - 2 * G2))), a));
+  __m256 x2 = _mm256_add_ps(x0, _mm256_set1_ps(2 * (float)G2 - 1));
+  __m256 y2 = _mm256_add_ps(y0, _mm256_set1_ps(2 * (float)G2 - 1));
+  __m256 c2 = _mm256_mul_ps(c, c);
+  __m256 n2 = _mm256_mul_ps(_mm256_mul_ps(c2, c2),
+                            GradCoord(seed, _mm256_add_epi32(i, prime_x), _mm256_add_epi32(j, prime_y), x2, y2));
+  n2 = _mm256_and_ps(n2, _mm256_cmp_ps(c, zero, _CMP_GT_OQ));
+
+  // The middle corner is (0, 1) above the diagonal and (1, 0) below it.
+  __m256 upper = _mm256_cmp_ps(y0, x0, _CMP_GT_OQ);
+  __m256i upper_i = _mm256_castps_si256(upper);
+  __m256 x1 = _mm256_add_ps(x0, _mm256_blendv_ps(_mm256_set1_ps((float)G2 - 1), _mm256_set1_ps((float)G2), upper));
+  __m256 y1 = _mm256_add_ps(y0, _mm256_blendv_ps(_mm256_set1_ps((float)G2), _mm256_set1_ps((float)G2 - 1), upper));
+  __m256i i1 = _mm256_add_epi32(i, _mm256_andnot_si256(upper_i, prime_x));
+  __m256i j1 = _mm256_add_epi32(j, _mm256_and_si256(upper_i, prime_y));
+
+  __m256 b = _mm256_sub_ps(_mm256_sub_ps(half, _mm256_mul_ps(x1, x1)), _mm256_mul_ps(y1, y1));
+  __m256 b2 = _mm256_mul_ps(b, b);
+  __m256 n1 = _mm256_mul_ps(_mm256_mul_ps(b2, b2), GradCoord(seed, i1, j1, x1, y1));
+  n1 = _mm256_and_ps(n1, _mm256_cmp_ps(b, zero, _CMP_GT_OQ));
+
+  return _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(n0, n1), n2), _mm256_set1_ps(99.83685446303647f));
+}
+
+__m256 SinglePerlin(__m256i seed, __m256 x, __m256 y) {
+  __m256i x0 = FastFloor(x);
+  __m256i y0 = FastFloor(y);
+
+  const __m256 one = _mm256_set1_ps(1.0f);
+  __m256 xd0 = _mm256_sub_ps(x, _mm256_cvtepi32_ps(x0));
+  __m256 yd0 = _mm256_sub_ps(y, _mm256_cvtepi32_ps(y0));
+  __m256 xd1 = _mm256_sub_ps(xd0, one);
+  __m256 yd1 = _mm256_sub_ps(yd0, one);
+
+  // t * t * t * (t * (t * 6 - 15) + 10)
+  auto quintic = [](__m256 t) {
+    __m256 inner = _mm256_sub_ps(_mm256_mul_ps(t, _mm256_set1_ps(6.0f)), _mm256_set1_ps(15.0f));
+    inner = _mm256_add_ps(_mm256_mul_ps(t, inner), _mm256_set1_ps(10.0f));
+    return _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(t, t), t), inner);
+  };
+  __m256 xs = quintic(xd0);
+  __m256 ys = quintic(yd0);
+
+  x0 = _mm256_mullo_epi32(x0, _mm256_set1_epi32(kPrimeX));
+  y0 = _mm256_mullo_epi32(y0, _mm256_set1_epi32(kPrimeY));
+  __m256i x1 = _mm256_add_epi32(x0, _mm256_set1_epi32(kPrimeX));
+  __m256i y1 = _mm256_add_epi32(y0, _mm256_set1_epi32(kPrimeY));
+
+  __m256 xf0 = Lerp(GradCoord(seed, x0, y0, xd0, yd0), GradCoord(seed, x1, y0, xd1, yd0), xs);
+  __m256 xf1 = Lerp(GradCoord(seed, x0, y1, xd0, yd1), GradCoord(seed, x1, y1, xd1, yd1), xs);
+  return _mm256_mul_ps(Lerp(xf0, xf1, ys), _mm256_set1_ps(1.4247691104677813f));
+}
+
+__m256 SingleValue(__m256i seed, __m256 x, __m256 y) {
+  __m256i x0 = FastFloor(x);
+  __m256i y0 = FastFloor(y);
+
+  // t * t * (3 - 2 * t)
+  auto hermite = [](__m256 t) {
+    __m256 inner = _mm256_sub_ps(_mm256_set1_ps(3.0f), _mm256_mul_ps(_mm256_set1_ps(2.0f), t));
+    return _mm256_mul_ps(_mm256_mul_ps(t, t), inner);
+  };
+  __m256 xs = hermite(_mm256_sub_ps(x, _mm256_cvtepi32_ps(x0)));
+  __m256 ys = hermite(_mm256_sub_ps(y, _mm256_cvtepi32_ps(y0)));
+
+  x0 = _mm256_mullo_epi32(x0, _mm256_set1_epi32(kPrimeX));
+  y0 = _mm256_mullo_epi32(y0, _mm256_set1_epi32(kPrimeY));
+  __m256i x1 = _mm256_add_epi32(x0, _mm256_set1_epi32(kPrimeX));
+  __m256i y1 = _mm256_add_epi32(y0, _mm256_set1_epi32(kPrimeY));
+
+  __m256 xf0 = Lerp(ValCoord(seed, x0, y0), ValCoord(seed, x1, y0), xs);
+  __m256 xf1 = Lerp(ValCoord(seed, x0, y1), ValCoord(seed, x1, y1), xs);
+  return Lerp(xf0, xf1, ys);
+}
+
+FORCE_INLINE __m256 CubicLerp(__m256 a, __m256 b, __m256 c, __m256 d, __m256 t) {
+  // p = (d - c) - (a - b), t * t * t * p + t * t * ((a - b) - p) + t * (c - a) + b
+  __m256 a_b = _mm256_sub_ps(a, b);
+  __m256 p = _mm256_sub_ps(_mm256_sub_ps(d, c), a_b);
+  __m256 t2 = _mm256_mul_ps(t, t);
+  __m256 result = _mm256_mul_ps(_mm256_mul_ps(t2, t), p);
+  result = _mm256_add_ps(result, _mm256_mul_ps(t2, _mm256_sub_ps(a_b, p)));
+  result = _mm256_add_ps(result, _mm256_mul_ps(t, _mm256_sub_ps(c, a)));
+  return _mm256_add_ps(result, b);
+}
+
+__m256 SingleValueCubic(__m256i seed, __m256 x, __m256 y) {
+  __m256i x1 = FastFloor(x);
+  __m256i y1 = FastFloor(y);
+
+  __m256 xs = _mm256_sub_ps(x, _mm256_cvtepi32_ps(x1));
+  __m256 ys = _mm256_sub_ps(y, _mm256_cvtepi32_ps(y1));
+
+  x1 = _mm256_mullo_epi32(x1, _mm256_set1_epi32(kPrimeX));
+  y1 = _mm256_mullo_epi32(y1, _mm256_set1_epi32(kPrimeY));
+  // The x3/y3 offsets are twice the prime, which wraps around for Y like FastNoiseLite's (int)((long)Prime << 1).
+  const __m256i prime_x = _mm256_set1_epi32(kPrimeX);
+  const __m256i prime_y = _mm256_set1_epi32(kPrimeY);
+  __m256i xp[4] = {_mm256_sub_epi32(x1, prime_x), x1, _mm256_add_epi32(x1, prime_x),
+                   _mm256_add_epi32(x1, _mm256_add_epi32(prime_x, prime_x))};
+  __m256i yp[4] = {_mm256_sub_epi32(y1, prime_y), y1, _mm256_add_epi32(y1, prime_y),
+                   _mm256_add_epi32(y1, _mm256_add_epi32(prime_y, prime_y))};
+
+  __m256 rows[4];
+  for (int r = 0; r < 4; ++r) {
+    rows[r] = CubicLerp(ValCoord(seed, xp[0], yp[r]), ValCoord(seed, xp[1], yp[r]), ValCoord(seed, xp[2], yp[r]),
+                        ValCoord(seed, xp[3], yp[r]), xs);
+  }
+
+  return _mm256_mul_ps(CubicLerp(rows[0], rows[1], rows[2], rows[3], ys), _mm256_set1_ps(1 / (1.5f * 1.5f)));
+}
+
+FORCE_INLINE __m256 GenNoiseSingle(FastNoiseLite::NoiseType type, int seed, __m256 x, __m256 y) {
+  __m256i seeds = _mm256_set1_epi32(seed);
+  switch (type) {
+  case FastNoiseLite::NoiseType_OpenSimplex2:
+    return SingleSimplex(seeds, x, y);
+  case FastNoiseLite::NoiseType_Perlin:
+    return SinglePerlin(seeds, x, y);
+  case FastNoiseLite::NoiseType_ValueCubic:
+    return SingleValueCubic(seeds, x, y);
+  case FastNoiseLite::NoiseType_Value:
+  default:
+    return SingleValue(seeds, x, y);
+  }
+}
+
+FORCE_INLINE __m256 PingPong(__m256 t) {
+  // t -= (int)(t * 0.5f) * 2, t < 1 ? t : 2 - t
+  __m256i whole = _mm256_slli_epi32(_mm256_cvttps_epi32(_mm256_mul_ps(t, _mm256_set1_ps(0.5f))), 1);
+  t = _mm256_sub_ps(t, _mm256_cvtepi32_ps(whole));
+  __m256 below_one = _mm256_cmp_ps(t, _mm256_set1_ps(1.0f), _CMP_LT_OQ);
+  return _mm256_blendv_ps(_mm256_sub_ps(_mm256_set1_ps(2.0f), t), t, below_one);
+}
+
+__m256 GetNoise8(const GeneratorSettings &settings, float fractal_bounding, __m256 x, __m256 y) {
+  x = _mm256_mul_ps(x, _mm256_set1_ps(settings.frequency));
+  y = _mm256_mul_ps(y, _mm256_set1_ps(settings.frequency));
+
+  if (settings.noise_type == FastNoiseLite::NoiseType_OpenSimplex2) {
+    const float SQRT3 = 1.7320508075688772935274463415059f;
+    const float F2 = 0.5f * (SQRT3 - 1);
+    __m256 t = _mm256_mul_ps(_mm256_add_ps(x, y), _mm256_set1_ps(F2));
+    x = _mm256_add_ps(x, t);
+    y = _mm256_add_ps(y, t);
+  }
+
+  const FastNoiseLite::NoiseType type = settings.noise_type;
+  const __m256 lacunarity = _mm256_set1_ps(settings.lacunarity);
+  int seed = settings.seed;
+  float amp = fractal_bounding;
+  __m256 sum = _mm256_setzero_ps();
+
+  switch (settings.fractal_type) {
+  case FastNoiseLite::FractalType_FBm:
+    for (int i = 0; i < settings.octaves; i++) {
+      __m256 noise = GenNoiseSingle(type, seed++, x, y);
+      sum = _mm256_add_ps(sum, _mm256_mul_ps(noise, _mm256_set1_ps(amp)));
+      x = _mm256_mul_ps(x, lacunarity);
+      y = _mm256_mul_ps(y, lacunarity);
+      amp *= settings.gain;
+    }
+    return sum;
+  case FastNoiseLite::FractalType_Ridged:
+    for (int i = 0; i < settings.octaves; i++) {
+      __m256 noise = GenNoiseSingle(type, seed++, x, y);
+      noise = _mm256_andnot_ps(_mm256_set1_ps(-0.0f), noise);
+      __m256 ridge = _mm256_add_ps(_mm256_mul_ps(noise, _mm256_set1_ps(-2.0f)), _mm256_set1_ps(1.0f));
+      sum = _mm256_add_ps(sum, _mm256_mul_ps(ridge, _mm256_set1_ps(amp)));
+      x = _mm256_mul_ps(x, lacunarity);
+      y = _mm256_mul_ps(y, lacunarity);
+      amp *= settings.gain;
+    }
+    return sum;
+  case FastNoiseLite::FractalType_PingPong:
+    for (int i = 0; i < settings.octaves; i++) {
+      __m256 noise = GenNoiseSingle(type, seed++, x, y);
+      noise = PingPong(_mm256_mul_ps(_mm256_add_ps(noise, _mm256_set1_ps(1.0f)), _mm256_set1_ps(2.0f)));
+      __m256 centered = _mm256_mul_ps(_mm256_sub_ps(noise, _mm256_set1_ps(0.5f)), _mm256_set1_ps(2.0f));
+      sum = _mm256_add_ps(sum, _mm256_mul_ps(centered, _mm256_set1_ps(amp)));
+      x = _mm256_mul_ps(x, lacunarity);
+      y = _mm256_mul_ps(y, lacunarity);
+      amp *= settings.gain;
+    }
+    return sum;
+  default:
+    // Domain warp fractals don't affect plain noise.
+    return GenNoiseSingle(type, seed, x, y);
+  }
+}
+#endif
+} // namespace
+
+NoiseBatch::NoiseBatch(const GeneratorSettings &settings)
+    : m_settings{settings}, m_fractal_bounding{FractalBounding(settings)} {
+  settings.Apply(m_noise);
+}
+
+bool NoiseBatch::IsVectorized() const {
+#ifdef __AVX2__
+  switch (m_settings.noise_type) {
+  case FastNoiseLite::NoiseType_OpenSimplex2:
+  case FastNoiseLite::NoiseType_Perlin:
+  case FastNoiseLite::NoiseType_ValueCubic:
+  case FastNoiseLite::NoiseType_Value:
+    return true;
+  default:
+    return false;
+  }
+#else
+  return false;
+#endif
+}
+
+void NoiseBatch::SampleGrid(int start_x, int start_z, int width, int depth, float scale, float *out) const {
+  const bool vectorized = IsVectorized();
+  for (int z = 0; z < depth; ++z) {
+    const float sample_z = static_cast<float>(start_z + z) * scale;
+    float *row = out + z * width;
+
+    int x = 0;
+#ifdef __AVX2__
+    if (vectorized) {
+      const __m256 lanes = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+      for (; x + 8 <= width; x += 8) {
+        // Same rounding as the scalar path: the block coordinate is converted first, then scaled.
+        __m256 sample_x = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(start_x + x)), lanes);
+        sample_x = _mm256_mul_ps(sample_x, _mm256_set1_ps(scale));
+        _mm256_storeu_ps(row + x, GetNoise8(m_settings, m_fractal_bounding, sample_x, _mm256_set1_ps(sample_z)));
+      }
+    }
+#else
+    (void)vectorized;
+#endif
+
+    for (; x < width; ++x) {
+      row[x] = m_noise.GetNoise(static_cast<float>(start_x + x) * scale, sample_z);
+    }
+  }
+}
+} // namespace craft
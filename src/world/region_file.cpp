@@ -0,0 +1,514 @@
+#include "region_file.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <system_error>
+
+namespace craft {
+namespace {
+constexpr char const kRegionMagic[4] = {'C', 'R', 'R', 'G'};
+// Version 1 used 4 KiB sectors.
+constexpr uint32_t const kRegionVersion = 2;
+// First byte of a chunk payload.
+constexpr uint8_t const kChunkFormatVersion = 1;
+constexpr uint8_t const kChunkEditsFormatVersion = 2;
+
+constexpr char const kMetadataMagic[4] = {'C', 'R', 'W', 'D'};
+// Version 1 only stored the seed, of a world saved in full.
+constexpr uint32_t const kMetadataVersion = 5;
+
+// Magic and version, then the offset table. Everything is stored little-endian.
+constexpr size_t const kRegionHeaderSize = 8 + kRegionChunks * 8;
+constexpr uint32_t const kRegionHeaderSectors = (kRegionHeaderSize + kRegionSectorSize - 1) / kRegionSectorSize;
+
+uint32_t SectorsFor(size_t bytes) { return static_cast<uint32_t>((bytes + kRegionSectorSize - 1) / kRegionSectorSize); }
+
+template <typename T> void Write(std::vector<uint8_t> &out, T value) {
+  uint8_t bytes[sizeof(T)];
+  std::memcpy(bytes, &value, sizeof(T));
+  out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+void WriteVarint(std::vector<uint8_t> &out, uint64_t value) {
+  while (value >= 0x80) {
+    out.push_back(static_cast<uint8_t>(value) | 0x80);
+    value >>= 7;
+  }
+  out.push_back(static_cast<uint8_t>(value));
+}
+
+// Bounds-checked cursor over a payload, any read past the end fails and sticks.
+struct Reader {
+  std::span<const uint8_t> data;
+  size_t offset = 0;
+  bool ok = true;
+
+  template <typename T> T Read() {
+    T value{};
+    if (!ok || data.size() - offset < sizeof(T)) {
+      ok = false;
+      return value;
+    }
+
+    std::memcpy(&value, data.data() + offset, sizeof(T));
+    offset += sizeof(T);
+    return value;
+  }
+
+  uint64_t ReadVarint() {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      uint8_t byte = Read<uint8_t>();
+      value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+      if (!(byte & 0x80)) {
+        return value;
+      }
+    }
+
+    ok = false;
+    return 0;
+  }
+};
+
+ChunkPos RegionPos(ChunkPos pos) { return {FloorDiv(pos.x, kRegionSize), pos.y, FloorDiv(pos.z, kRegionSize)}; }
+
+std::string RegionFileName(ChunkPos region) {
+  return "r." + std::to_string(region.x) + "." + std::to_string(region.y) + "." + std::to_string(region.z) +
+         ".region";
+}
+} // namespace
+
+void EncodeChunk(const ChunkData &chunk, std::vector<uint8_t> &out) {
+  out.clear();
+  Write<uint8_t>(out, kChunkFormatVersion);
+  Write<uint8_t>(out, kSectionsPerChunk);
+
+  for (int i = 0; i < kSectionsPerChunk; ++i) {
+    const ChunkSection &section = chunk.GetSection(i);
+
+    auto palette = section.GetPalette();
+    Write<uint8_t>(out, static_cast<uint8_t>(palette.size()));
+    for (BlockType type : palette) {
+      Write<uint8_t>(out, static_cast<uint8_t>(type));
+    }
+
+    auto words = section.GetWords();
+    WriteVarint(out, words.size());
+    for (size_t w = 0; w < words.size();) {
+      size_t run = 1;
+      while (w + run < words.size() && words[w + run] == words[w]) {
+        ++run;
+      }
+
+      WriteVarint(out, run);
+      Write<uint64_t>(out, words[w]);
+      w += run;
+    }
+  }
+}
+
+bool DecodeChunk(std::span<const uint8_t> payload, Chunk &out) {
+  thread_local std::vector<uint64_t> words;
+  ChunkSection sections[kSectionsPerChunk];
+
+  Reader reader{payload};
+  if (reader.Read<uint8_t>() != kChunkFormatVersion || reader.Read<uint8_t>() != kSectionsPerChunk) {
+    return false;
+  }
+
+  for (int i = 0; i < kSectionsPerChunk; ++i) {
+    BlockType palette[kMaxPaletteSize];
+    size_t palette_size = reader.Read<uint8_t>();
+    if (palette_size > kMaxPaletteSize) {
+      return false;
+    }
+    for (size_t p = 0; p < palette_size; ++p) {
+      palette[p] = static_cast<BlockType>(reader.Read<uint8_t>());
+    }
+
+    uint64_t word_count = reader.ReadVarint();
+    if (word_count > kSectionVolume) {
+      return false;
+    }
+
+    words.clear();
+    while (reader.ok && words.size() < word_count) {
+      uint64_t run = reader.ReadVarint();
+      uint64_t word = reader.Read<uint64_t>();
+      if (run == 0 || run > word_count - words.size()) {
+        return false;
+      }
+      words.insert(words.end(), run, word);
+    }
+
+    if (!reader.ok || !sections[i].Load({palette, palette_size}, words)) {
+      return false;
+    }
+  }
+
+  out.Load(sections);
+  return true;
+}
+
+void EncodeChunkEdits(std::span<const BlockEdit> edits, std::vector<uint8_t> &out) {
+  out.clear();
+  Write<uint8_t>(out, kChunkEditsFormatVersion);
+  WriteVarint(out, edits.size());
+
+  uint32_t previous = 0;
+  for (const BlockEdit &edit : edits) {
+    WriteVarint(out, edit.index - previous);
+    Write<uint8_t>(out, static_cast<uint8_t>(edit.type));
+    previous = edit.index;
+  }
+}
+
+bool DecodeChunkEdits(std::span<const uint8_t> payload, std::vector<BlockEdit> &out) {
+  Reader reader{payload};
+  if (reader.Read<uint8_t>() != kChunkEditsFormatVersion) {
+    return false;
+  }
+
+  uint64_t count = reader.ReadVarint();
+  if (count > kChunkVolume) {
+    return false;
+  }
+
+  std::vector<BlockEdit> edits;
+  edits.reserve(count);
+  uint64_t index = 0;
+  for (uint64_t i = 0; i < count; ++i) {
+    index += reader.ReadVarint();
+    uint8_t type = reader.Read<uint8_t>();
+    if (!reader.ok || index >= kChunkVolume || type >= static_cast<uint8_t>(BlockType::Count) ||
+        (i > 0 && index == edits.back().index)) {
+      return false;
+    }
+
+    edits.push_back({static_cast<uint16_t>(index), static_cast<BlockType>(type)});
+  }
+
+  out = std::move(edits);
+  return true;
+}
+
+bool RegionFile::Open(const std::filesystem::path &path) {
+  std::lock_guard lock{m_mutex};
+  if (!m_file.Open(path)) {
+    return false;
+  }
+
+  if (m_file.GetSize() == 0) {
+    std::vector<uint8_t> header(kRegionHeaderSectors * kRegionSectorSize, 0);
+    std::memcpy(header.data(), kRegionMagic, sizeof(kRegionMagic));
+    std::memcpy(header.data() + 4, &kRegionVersion, sizeof(kRegionVersion));
+    return m_file.Write(0, header);
+  }
+
+  auto view = m_file.Map();
+  uint32_t version = 0;
+  if (view.size() < kRegionHeaderSize || std::memcmp(view.data(), kRegionMagic, sizeof(kRegionMagic)) != 0) {
+    return false;
+  }
+  std::memcpy(&version, view.data() + 4, sizeof(version));
+  return version == kRegionVersion;
+}
+
+bool RegionFile::HasChunk(int local_x, int local_z) {
+  std::lock_guard lock{m_mutex};
+  return GetEntry(EntryIndex(local_x, local_z)).sector != 0;
+}
+
+bool RegionFile::ReadChunk(int local_x, int local_z, Chunk &out) {
+  std::lock_guard lock{m_mutex};
+  auto payload = GetPayload(EntryIndex(local_x, local_z));
+  return !payload.empty() && DecodeChunk(payload, out);
+}
+
+bool RegionFile::ReadChunkEdits(int local_x, int local_z, std::vector<BlockEdit> &out) {
+  std::lock_guard lock{m_mutex};
+  auto payload = GetPayload(EntryIndex(local_x, local_z));
+  return !payload.empty() && DecodeChunkEdits(payload, out);
+}
+
+bool RegionFile::WriteChunk(int local_x, int local_z, std::span<const uint8_t> payload) {
+  std::lock_guard lock{m_mutex};
+
+  if (m_used_sectors.empty()) {
+    m_used_sectors.assign(SectorsFor(m_file.GetSize()), false);
+    MarkSectors(0, kRegionHeaderSectors, true);
+    for (size_t i = 0; i < kRegionChunks; ++i) {
+      // Entries pointing past the end of the file are corrupt, they fail to read anyway.
+      Entry entry = GetEntry(i);
+      if (entry.sector != 0 && entry.sector + SectorsFor(entry.length) <= m_used_sectors.size()) {
+        MarkSectors(entry.sector, SectorsFor(entry.length), true);
+      }
+    }
+  }
+
+  const size_t index = EntryIndex(local_x, local_z);
+  const Entry old = GetEntry(index);
+  const uint32_t old_sectors = SectorsFor(old.length);
+  const uint32_t sectors = std::max(SectorsFor(payload.size()), 1u);
+
+  Entry entry{old.sector, static_cast<uint32_t>(payload.size())};
+  if (old.sector == 0 || sectors > old_sectors) {
+    entry.sector = AllocateSectors(sectors);
+  }
+
+  // Padding to whole sectors keeps the end of the file sector aligned.
+  thread_local std::vector<uint8_t> padded;
+  padded.assign(payload.begin(), payload.end());
+  padded.resize(static_cast<size_t>(sectors) * kRegionSectorSize, 0);
+  if (!m_file.Write(static_cast<size_t>(entry.sector) * kRegionSectorSize, padded)) {
+    if (entry.sector != old.sector) {
+      MarkSectors(entry.sector, sectors, false);
+    }
+    return false;
+  }
+
+  uint8_t bytes[sizeof(Entry)];
+  std::memcpy(bytes, &entry, sizeof(Entry));
+  if (!m_file.Write(8 + index * sizeof(Entry), bytes)) {
+    return false;
+  }
+
+  if (entry.sector != old.sector) {
+    MarkSectors(old.sector, old_sectors, false);
+  } else if (sectors < old_sectors) {
+    MarkSectors(entry.sector + sectors, old_sectors - sectors, false);
+  }
+
+  return true;
+}
+
+RegionFile::Entry RegionFile::GetEntry(size_t index) {
+  Entry entry{};
+  auto view = m_file.Map();
+  if (view.size() >= kRegionHeaderSize) {
+    std::memcpy(&entry, view.data() + 8 + index * sizeof(Entry), sizeof(Entry));
+  }
+
+  return entry;
+}
+
+std::span<const uint8_t> RegionFile::GetPayload(size_t index) {
+  Entry entry = GetEntry(index);
+  if (entry.sector == 0) {
+    return {};
+  }
+
+  auto view = m_file.Map();
+  size_t offset = static_cast<size_t>(entry.sector) * kRegionSectorSize;
+  if (offset > view.size() || view.size() - offset < entry.length) {
+    return {};
+  }
+
+  return view.subspan(offset, entry.length);
+}
+
+uint32_t RegionFile::AllocateSectors(uint32_t count) {
+  uint32_t run = 0;
+  for (uint32_t sector = kRegionHeaderSectors; sector < m_used_sectors.size(); ++sector) {
+    run = m_used_sectors[sector] ? 0 : run + 1;
+    if (run == count) {
+      MarkSectors(sector + 1 - count, count, true);
+      return sector + 1 - count;
+    }
+  }
+
+  // Nothing free is big enough, append (reusing a free tail if there is one).
+  uint32_t sector = static_cast<uint32_t>(m_used_sectors.size()) - run;
+  MarkSectors(sector, count, true);
+  return sector;
+}
+
+void RegionFile::MarkSectors(uint32_t sector, uint32_t count, bool used) {
+  if (m_used_sectors.size() < sector + count) {
+    m_used_sectors.resize(sector + count, false);
+  }
+
+  std::fill_n(m_used_sectors.begin() + sector, count, used);
+}
+
+bool RegionStorage::Open(const std::filesystem::path &directory) {
+  std::error_code error;
+  for (const char *subdirectory : {"region", "features"}) {
+    std::filesystem::create_directories(directory / subdirectory, error);
+    if (error) {
+      return false;
+    }
+  }
+
+  std::lock_guard lock{m_mutex};
+  m_directory = directory;
+  m_regions.clear();
+  m_feature_regions.clear();
+  return true;
+}
+
+bool RegionStorage::LoadMetadata(WorldMetadata &out) const {
+  std::ifstream file(m_directory / "world.meta", std::ios::binary);
+  std::vector<uint8_t> bytes{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+
+  Reader reader{bytes};
+  char magic[4];
+  for (char &c : magic) {
+    c = reader.Read<char>();
+  }
+  uint32_t version = reader.Read<uint32_t>();
+  if (!reader.ok || std::memcmp(magic, kMetadataMagic, sizeof(magic)) != 0 || version < 1 ||
+      version > kMetadataVersion) {
+    return false;
+  }
+
+  WorldMetadata metadata;
+  if (version == 1) {
+    metadata.mode = PersistenceMode::Full;
+    metadata.generator.seed = reader.Read<int32_t>();
+    // Sampled every column, like every world from before coarse sampling.
+    metadata.generator.sample_spacing = 1;
+  } else {
+    uint8_t mode = reader.Read<uint8_t>();
+    metadata.mode = mode == 0 ? PersistenceMode::Full : PersistenceMode::EditDeltas;
+    metadata.generator_version = reader.Read<uint32_t>();
+
+    GeneratorSettings &generator = metadata.generator;
+    generator.seed = reader.Read<int32_t>();
+    generator.noise_type = static_cast<FastNoiseLite::NoiseType>(reader.Read<int32_t>());
+    generator.fractal_type = static_cast<FastNoiseLite::FractalType>(reader.Read<int32_t>());
+    generator.octaves = reader.Read<int32_t>();
+    generator.lacunarity = reader.Read<float>();
+    generator.gain = reader.Read<float>();
+    generator.frequency = reader.Read<float>();
+    generator.max_height = reader.Read<float>();
+    generator.scale = reader.Read<float>();
+    // Worlds from before coarse sampling sampled every column.
+    generator.sample_spacing = version >= 3 ? reader.Read<int32_t>() : 1;
+    generator.shape = version >= 4 ? static_cast<TerrainShape>(reader.Read<int32_t>()) : TerrainShape::Heightmap;
+    if (version >= 5) {
+      generator.surface.sea_level = reader.Read<int32_t>();
+      generator.surface.soil_depth = reader.Read<int32_t>();
+      generator.tree_density = reader.Read<float>();
+    }
+  }
+
+  if (!IsValidSampleSpacing(metadata.generator.sample_spacing) || metadata.generator.shape < TerrainShape::Heightmap ||
+      metadata.generator.shape >= TerrainShape::Count) {
+    return false;
+  }
+
+  if (!reader.ok) {
+    return false;
+  }
+
+  out = metadata;
+  return true;
+}
+
+bool RegionStorage::SaveMetadata(const WorldMetadata &metadata) const {
+  std::vector<uint8_t> bytes(kMetadataMagic, kMetadataMagic + sizeof(kMetadataMagic));
+  Write<uint32_t>(bytes, kMetadataVersion);
+  Write<uint8_t>(bytes, static_cast<uint8_t>(metadata.mode));
+  Write<uint32_t>(bytes, metadata.generator_version);
+
+  const GeneratorSettings &generator = metadata.generator;
+  Write<int32_t>(bytes, generator.seed);
+  Write<int32_t>(bytes, generator.noise_type);
+  Write<int32_t>(bytes, generator.fractal_type);
+  Write<int32_t>(bytes, generator.octaves);
+  Write<float>(bytes, generator.lacunarity);
+  Write<float>(bytes, generator.gain);
+  Write<float>(bytes, generator.frequency);
+  Write<float>(bytes, generator.max_height);
+  Write<float>(bytes, generator.scale);
+  Write<int32_t>(bytes, generator.sample_spacing);
+  Write<int32_t>(bytes, static_cast<int32_t>(generator.shape));
+  Write<int32_t>(bytes, generator.surface.sea_level);
+  Write<int32_t>(bytes, generator.surface.soil_depth);
+  Write<float>(bytes, generator.tree_density);
+
+  std::ofstream file(m_directory / "world.meta", std::ios::binary | std::ios::trunc);
+  file.write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+  return static_cast<bool>(file);
+}
+
+bool RegionStorage::LoadChunk(ChunkPos pos, Chunk &out) {
+  RegionFile *file = GetRegion(RegionPos(pos), false);
+  return file && file->ReadChunk(FloorMod(pos.x, kRegionSize), FloorMod(pos.z, kRegionSize), out);
+}
+
+bool RegionStorage::SaveChunk(ChunkPos pos, const ChunkData &chunk) {
+  RegionFile *file = GetRegion(RegionPos(pos), true);
+  if (!file) {
+    return false;
+  }
+
+  thread_local std::vector<uint8_t> payload;
+  EncodeChunk(chunk, payload);
+  return file->WriteChunk(FloorMod(pos.x, kRegionSize), FloorMod(pos.z, kRegionSize), payload);
+}
+
+bool RegionStorage::LoadChunkEdits(ChunkPos pos, std::vector<BlockEdit> &out) {
+  RegionFile *file = GetRegion(RegionPos(pos), false);
+  return file && file->ReadChunkEdits(FloorMod(pos.x, kRegionSize), FloorMod(pos.z, kRegionSize), out);
+}
+
+bool RegionStorage::SaveChunkEdits(ChunkPos pos, std::span<const BlockEdit> edits) {
+  RegionFile *file = GetRegion(RegionPos(pos), true);
+  if (!file) {
+    return false;
+  }
+
+  thread_local std::vector<uint8_t> payload;
+  EncodeChunkEdits(edits, payload);
+  return file->WriteChunk(FloorMod(pos.x, kRegionSize), FloorMod(pos.z, kRegionSize), payload);
+}
+
+bool RegionStorage::LoadPendingFeatures(ChunkPos pos, std::vector<BlockEdit> &out) {
+  RegionFile *file = GetRegion(RegionPos(pos), false, true);
+  return file && file->ReadChunkEdits(FloorMod(pos.x, kRegionSize), FloorMod(pos.z, kRegionSize), out);
+}
+
+bool RegionStorage::SavePendingFeatures(ChunkPos pos, std::span<const BlockEdit> edits) {
+  RegionFile *file = GetRegion(RegionPos(pos), !edits.empty(), true);
+  if (!file) {
+    // Nothing to clear if the region was never written.
+    return edits.empty();
+  }
+
+  thread_local std::vector<uint8_t> payload;
+  EncodeChunkEdits(edits, payload);
+  return file->WriteChunk(FloorMod(pos.x, kRegionSize), FloorMod(pos.z, kRegionSize), payload);
+}
+
+RegionFile *RegionStorage::GetRegion(ChunkPos region, bool create, bool features) {
+  std::lock_guard lock{m_mutex};
+  if (m_directory.empty()) {
+    return nullptr;
+  }
+
+  auto &regions = features ? m_feature_regions : m_regions;
+  auto it = regions.find(region);
+  if (it != regions.end() && (it->second || !create)) {
+    return it->second.get();
+  }
+
+  std::filesystem::path path = m_directory / (features ? "features" : "region") / RegionFileName(region);
+  std::error_code error;
+  std::unique_ptr<RegionFile> file;
+  if (create || std::filesystem::exists(path, error)) {
+    file = std::make_unique<RegionFile>();
+    if (!file->Open(path)) {
+      file.reset();
+    }
+  }
+
+  RegionFile *result = file.get();
+  regions[region] = std::move(file);
+  return result;
+}
+} // namespace craft
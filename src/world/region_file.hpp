@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include "platform/mapped_file.hpp"
+#include "world/chunk.hpp"
+#include "world/chunk_edits.hpp"
+#include "world/chunk_map.hpp"
+#include "world/generator_settings.hpp"
+
+namespace craft {
+// A region file holds a kRegionSize x kRegionSize grid of chunks of a single chunk layer.
+constexpr int32_t const kRegionSize = 32;
+constexpr size_t const kRegionChunks = kRegionSize * kRegionSize;
+
+// Payloads are placed on sector boundaries, so rewriting a chunk in place never disturbs its neighbors in the file.
+// Sectors are small since edit deltas are usually only a few dozen bytes.
+constexpr size_t const kRegionSectorSize = 512;
+
+// Serializes a chunk's sections: each section is its palette followed by its packed words, run-length encoded (terrain
+// is mostly long runs of identical words). Uniform sections are just their palette entry.
+void EncodeChunk(const ChunkData &chunk, std::vector<uint8_t> &out);
+
+// Returns false, leaving `out` untouched, if the payload is truncated or malformed.
+bool DecodeChunk(std::span<const uint8_t> payload, Chunk &out);
+
+// Serializes the edits of a chunk (sorted by index): delta-coded indices and block types, 2 bytes for most edits.
+void EncodeChunkEdits(std::span<const BlockEdit> edits, std::vector<uint8_t> &out);
+bool DecodeChunkEdits(std::span<const uint8_t> payload, std::vector<BlockEdit> &out);
+
+// One region file: a header with an offset table (one entry per chunk) followed by the chunk payloads. The file is read
+// through a memory mapping, so opening it costs nothing and only the chunks that are actually read get paged in.
+// Writes go through the file: a payload that still fits its old sectors is rewritten in place, anything else is moved
+// to the first free run of sectors (usually the end of the file) and its table entry updated once the payload is on
+// disk. Saving one chunk never rewrites the rest of the file.
+class RegionFile {
+public:
+  bool Open(const std::filesystem::path &path);
+
+  bool HasChunk(int local_x, int local_z);
+  bool ReadChunk(int local_x, int local_z, Chunk &out);
+  bool ReadChunkEdits(int local_x, int local_z, std::vector<BlockEdit> &out);
+  bool WriteChunk(int local_x, int local_z, std::span<const uint8_t> payload);
+
+private:
+  struct Entry {
+    // In sectors, 0 (the header) when the chunk isn't stored.
+    uint32_t sector;
+    uint32_t length;
+  };
+
+  static size_t EntryIndex(int local_x, int local_z) { return static_cast<size_t>(local_z * kRegionSize + local_x); }
+
+  Entry GetEntry(size_t index);
+  // Empty if the chunk isn't stored or its entry is out of bounds. Only valid while the lock is held.
+  std::span<const uint8_t> GetPayload(size_t index);
+  uint32_t AllocateSectors(uint32_t count);
+  void MarkSectors(uint32_t sector, uint32_t count, bool used);
+
+private:
+  std::mutex m_mutex;
+  MappedFile m_file;
+
+  // Built on the first write, reads never need it.
+  std::vector<bool> m_used_sectors;
+};
+
+enum class PersistenceMode : uint8_t {
+  // Every chunk that was loaded is saved in full.
+  Full,
+  // Only edits are saved, chunks are regenerated from the generator settings and the edits replayed on top.
+  EditDeltas,
+};
+
+// Persistent state of a world that isn't chunk data.
+struct WorldMetadata {
+  PersistenceMode mode = PersistenceMode::EditDeltas;
+  uint32_t generator_version = kGeneratorVersion;
+  GeneratorSettings generator;
+};
+
+// A saved world: a directory with the world metadata and a subdirectory of region files, which are opened as chunks
+// in them are first asked for.
+class RegionStorage {
+public:
+  // Creates the directory if it doesn't exist yet.
+  bool Open(const std::filesystem::path &directory);
+  const std::filesystem::path &GetDirectory() const { return m_directory; }
+
+  bool LoadMetadata(WorldMetadata &out) const;
+  bool SaveMetadata(const WorldMetadata &metadata) const;
+
+  // Returns false if the chunk has never been saved.
+  bool LoadChunk(ChunkPos pos, Chunk &out);
+  bool SaveChunk(ChunkPos pos, const ChunkData &chunk);
+
+  bool LoadChunkEdits(ChunkPos pos, std::vector<BlockEdit> &out);
+  bool SaveChunkEdits(ChunkPos pos, std::span<const BlockEdit> edits);
+
+  // Feature blocks that other chunks placed in the chunk at `pos` while it wasn't loaded, for worlds saved in full.
+  // Kept in region files of their own, since the chunk's entry may already hold the chunk. Saving none clears them.
+  bool LoadPendingFeatures(ChunkPos pos, std::vector<BlockEdit> &out);
+  bool SavePendingFeatures(ChunkPos pos, std::span<const BlockEdit> edits);
+
+private:
+  RegionFile *GetRegion(ChunkPos region, bool create, bool features = false);
+
+private:
+  std::filesystem::path m_directory;
+
+  std::mutex m_mutex;
+  // Null for regions known not to exist yet.
+  std::unordered_map<ChunkPos, std::unique_ptr<RegionFile>, ChunkPosHash> m_regions;
+  std::unordered_map<ChunkPos, std::unique_ptr<RegionFile>, ChunkPosHash> m_feature_regions;
+};
+} // namespace craft
@@ -1,38 +1,562 @@
 #pragma once
 
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include <FastNoiseLite/FastNoiseLite.h>
+#include <glm/glm.hpp>
 
 #include "generator.hpp"
 #include "world/chunk.hpp"
+#include "world/chunk_edits.hpp"
+#include "world/chunk_map.hpp"
+#include "world/features.hpp"
+#include "world/generation_pipeline.hpp"
+#include "util/thread_pool.hpp"
+#include "world/region_file.hpp"
 
 namespace craft {
+struct RaycastHit {
+  BlockPos block;
+  // The empty block the ray passed through right before hitting `block`, i.e. where a placed block would go.
+  BlockPos previous;
+};
+
+// Horizontal distances, in chunks. Chunks are loaded within `load_radius` of the camera and only evicted once they're
+// past `unload_radius`, so moving back and forth across a chunk border doesn't thrash.
+struct StreamingSettings {
+  int load_radius = 8;
+  int unload_radius = 10;
+  // Loaded in parallel, so this should be at least the number of cores.
+  int max_loads_per_update = 16;
+};
+
 class World {
 public:
-  World(FastNoiseLite *noise) : m_noise{noise} {}
+  World() { SetStreamingSettings({}); }
+  ~World() { Save(); }
+
+  World(const World &) = delete;
+  World &operator=(const World &) = delete;
 
+  // Starts a new, unsaved world: drops every loaded chunk and reseeds the generator. Chunks are then streamed in
+  // around the camera by Update().
   void Generate() {
-    m_noise->SetFractalOctaves(5);
-    m_noise->SetFractalType(FastNoiseLite::FractalType_FBm);
-    m_noise->SetSeed(rand());
-    for (int x = 0; x < 16; ++x) {
-      for (int z = 0; z < 16; ++z) {
-        auto &chunk = m_chunks.emplace_back();
+    Save();
+    m_storage.reset();
+
+    WorldMetadata metadata;
+    metadata.generator.seed = rand();
+    Reset(metadata);
+  }
+
+  // Opens the saved world in `directory`, or starts a new one there, saved with `mode`, if it's empty. Chunks are
+  // streamed in from the region files as the camera gets near them, changed ones are written back when they're evicted
+  // and by Save().
+  bool Open(const std::filesystem::path &directory, PersistenceMode mode = PersistenceMode::EditDeltas) {
+    Save();
+
+    auto storage = std::make_unique<RegionStorage>();
+    if (!storage->Open(directory)) {
+      return false;
+    }
 
-        GenerateChunk(false, 16.0f, *m_noise, chunk, 1.0f, x * kMaxChunkWidth, z * kMaxChunkDepth);
-        chunk.x = x;
-        chunk.z = z;
-        chunk.y = 0;
+    WorldMetadata metadata;
+    if (storage->LoadMetadata(metadata)) {
+      // Edits only make sense on top of the terrain they were made on.
+      if (metadata.mode == PersistenceMode::EditDeltas && metadata.generator_version != kGeneratorVersion) {
+        return false;
       }
+    } else {
+      metadata.mode = mode;
+      metadata.generator.seed = rand();
+      if (!storage->SaveMetadata(metadata)) {
+        return false;
+      }
+    }
+
+    m_storage = std::move(storage);
+    Reset(metadata);
+    return true;
+  }
+
+  // Writes every loaded chunk that changed since it was last saved.
+  void Save() {
+    for (ChunkPos pos : m_unsaved_chunks) {
+      SaveChunk(pos);
     }
+
+    m_unsaved_chunks.clear();
   }
 
-  Chunk *GetChunk(int index) { return &m_chunks[index]; }
-  std::vector<Chunk> &GetChunks() { return m_chunks; }
+  const WorldMetadata &GetMetadata() const { return m_metadata; }
+  // Where the world is saved, empty if it isn't.
+  std::filesystem::path GetDirectory() const { return m_storage ? m_storage->GetDirectory() : std::filesystem::path{}; }
+  GenerationStats GetGenerationStats() const { return m_generator.GetStats(); }
+
+  // Keeps every chunk column within the load radius of `position` loaded, generating at most
+  // `max_loads_per_update` columns per call (nearest first), and evicts columns past the unload radius. Evicted chunks
+  // are reported through the dirty set so the renderer drops their meshes.
+  void Update(glm::vec3 position) {
+    int center_x = FloorDiv(static_cast<int32_t>(std::floor(position.x)), kMaxChunkWidth);
+    int center_z = FloorDiv(static_cast<int32_t>(std::floor(position.z)), kMaxChunkDepth);
+
+    bool center_changed = !m_has_stream_center || center_x != m_stream_center_x || center_z != m_stream_center_z;
+    if (!center_changed && m_stream_complete) {
+      return;
+    }
+
+    m_has_stream_center = true;
+    m_stream_center_x = center_x;
+    m_stream_center_z = center_z;
+
+    if (center_changed) {
+      EvictDistantChunks();
+    }
+
+    m_columns_to_load.clear();
+    m_stream_complete = true;
+    for (auto [dx, dz] : m_load_offsets) {
+      if (m_chunks.Find({center_x + dx, 0, center_z + dz})) {
+        continue;
+      }
+
+      if (m_columns_to_load.size() == static_cast<size_t>(m_streaming.max_loads_per_update)) {
+        m_stream_complete = false;
+        break;
+      }
+
+      m_columns_to_load.emplace_back(center_x + dx, center_z + dz);
+    }
+
+    LoadChunkColumns();
+  }
+
+  const StreamingSettings &GetStreamingSettings() const { return m_streaming; }
+  void SetStreamingSettings(const StreamingSettings &settings) {
+    m_streaming = settings;
+    m_streaming.unload_radius = std::max(m_streaming.unload_radius, m_streaming.load_radius + 1);
+
+    m_load_offsets.clear();
+    int radius = m_streaming.load_radius;
+    for (int dx = -radius; dx <= radius; ++dx) {
+      for (int dz = -radius; dz <= radius; ++dz) {
+        if (dx * dx + dz * dz <= radius * radius) {
+          m_load_offsets.emplace_back(dx, dz);
+        }
+      }
+    }
+    std::sort(m_load_offsets.begin(), m_load_offsets.end(), [](auto &a, auto &b) {
+      return a.first * a.first + a.second * a.second < b.first * b.first + b.second * b.second;
+    });
+
+    m_has_stream_center = false;
+  }
+
+  Chunk *GetChunk(ChunkPos pos) { return m_chunks.Find(pos); }
+  ChunkMap &GetChunks() { return m_chunks; }
+
+  // Blocks in unloaded chunks read as air.
+  BlockType GetBlock(BlockPos pos) const {
+    Chunk *chunk = m_chunks.Find(ChunkPosFromBlock(pos));
+    if (!chunk) {
+      return BlockType::Air;
+    }
+
+    auto [x, y, z] = ToLocal(pos);
+    return chunk->Get(z, x, y);
+  }
+
+  bool IsOccupied(BlockPos pos) const {
+    Chunk *chunk = m_chunks.Find(ChunkPosFromBlock(pos));
+    if (!chunk) {
+      return false;
+    }
+
+    auto [x, y, z] = ToLocal(pos);
+    return chunk->IsOccupied(z, x, y);
+  }
+
+  // Writes a block and marks the touched section dirty, along with the neighboring sections and chunks whose meshes
+  // can see the changed block. Returns false if the chunk isn't loaded.
+  bool SetBlock(BlockPos pos, BlockType type) {
+    ChunkPos chunk_pos = ChunkPosFromBlock(pos);
+    Chunk *chunk = m_chunks.Find(chunk_pos);
+    if (!chunk) {
+      return false;
+    }
+
+    auto [x, y, z] = ToLocal(pos);
+    if (chunk->Get(z, x, y) == type) {
+      return true;
+    }
+
+    chunk->Set(z, x, y, type);
+    if (m_storage) {
+      m_unsaved_chunks.insert(chunk_pos);
+      if (m_metadata.mode == PersistenceMode::EditDeltas) {
+        m_chunk_edits[chunk_pos].Record(z, x, y, type);
+      }
+    }
+
+    int section = y / kSectionSize;
+    uint32_t sections = 1u << section;
+    if (y % kSectionSize == 0 && section > 0) {
+      sections |= 1u << (section - 1);
+    }
+    if (y % kSectionSize == kSectionSize - 1 && section < kSectionsPerChunk - 1) {
+      sections |= 1u << (section + 1);
+    }
+    MarkChunkDirty(chunk_pos, sections);
+
+    // Edits on a chunk border change which faces the neighbor has to emit.
+    if (x == 0) {
+      MarkChunkDirty({chunk_pos.x - 1, chunk_pos.y, chunk_pos.z}, sections);
+    } else if (x == kMaxChunkWidth - 1) {
+      MarkChunkDirty({chunk_pos.x + 1, chunk_pos.y, chunk_pos.z}, sections);
+    }
+    if (z == 0) {
+      MarkChunkDirty({chunk_pos.x, chunk_pos.y, chunk_pos.z - 1}, sections);
+    } else if (z == kMaxChunkDepth - 1) {
+      MarkChunkDirty({chunk_pos.x, chunk_pos.y, chunk_pos.z + 1}, sections);
+    }
+    if (y == 0) {
+      MarkChunkDirty({chunk_pos.x, chunk_pos.y - 1, chunk_pos.z}, 1u << (kSectionsPerChunk - 1));
+    } else if (y == kMaxChunkHeight - 1) {
+      MarkChunkDirty({chunk_pos.x, chunk_pos.y + 1, chunk_pos.z}, 1u);
+    }
+
+    return true;
+  }
+
+  void MarkChunkDirty(ChunkPos pos, uint32_t sections = kAllSections) {
+    if (m_chunks.Find(pos)) {
+      m_dirty_chunks[pos] |= sections;
+    }
+  }
+
+  // Marks the loaded neighbors of `pos` dirty, for when the chunk there was loaded, unloaded or rewritten wholesale.
+  // Meshes cull their border faces against the neighbors, so only the sections facing `pos` are affected.
+  void MarkNeighborsDirty(ChunkPos pos) {
+    for (int i = 0; i < static_cast<int>(ChunkNeighbor::Count); ++i) {
+      const ChunkPos &offset = kChunkNeighborOffsets[i];
+      uint32_t sections = kAllSections;
+      if (static_cast<ChunkNeighbor>(i) == ChunkNeighbor::Top) {
+        sections = 1u;
+      } else if (static_cast<ChunkNeighbor>(i) == ChunkNeighbor::Bottom) {
+        sections = 1u << (kSectionsPerChunk - 1);
+      }
+      MarkChunkDirty({pos.x + offset.x, pos.y + offset.y, pos.z + offset.z}, sections);
+    }
+  }
+
+  // Dirty chunks with a bitmask of their dirty sections, this includes chunks that were just unloaded. The consumer
+  // (usually the renderer) clears them.
+  const std::unordered_map<ChunkPos, uint32_t, ChunkPosHash> &GetDirtyChunks() const { return m_dirty_chunks; }
+  void ClearDirtyChunks() { m_dirty_chunks.clear(); }
+
+  // Walks the blocks along a ray (Amanatides & Woo), stopping at the first non-air block.
+  std::optional<RaycastHit> Raycast(glm::vec3 origin, glm::vec3 direction, float max_distance) const {
+    direction = glm::normalize(direction);
+
+    BlockPos pos{static_cast<int32_t>(std::floor(origin.x)), static_cast<int32_t>(std::floor(origin.y)),
+                 static_cast<int32_t>(std::floor(origin.z))};
+    BlockPos previous = pos;
+
+    glm::ivec3 step{direction.x > 0 ? 1 : -1, direction.y > 0 ? 1 : -1, direction.z > 0 ? 1 : -1};
+    glm::vec3 delta = glm::abs(1.0f / direction);
+    glm::vec3 next{
+        (direction.x > 0 ? (pos.x + 1 - origin.x) : (origin.x - pos.x)) * delta.x,
+        (direction.y > 0 ? (pos.y + 1 - origin.y) : (origin.y - pos.y)) * delta.y,
+        (direction.z > 0 ? (pos.z + 1 - origin.z) : (origin.z - pos.z)) * delta.z,
+    };
+
+    float distance = 0.0f;
+    while (distance <= max_distance) {
+      if (IsOccupied(pos)) {
+        return RaycastHit{pos, previous};
+      }
+
+      previous = pos;
+      if (next.x < next.y && next.x < next.z) {
+        pos.x += step.x;
+        distance = next.x;
+        next.x += delta.x;
+      } else if (next.y < next.z) {
+        pos.y += step.y;
+        distance = next.y;
+        next.y += delta.y;
+      } else {
+        pos.z += step.z;
+        distance = next.z;
+        next.z += delta.z;
+      }
+    }
+
+    return std::nullopt;
+  }
+
+  static constexpr uint32_t const kAllSections = (1u << kSectionsPerChunk) - 1;
+
+private:
+  void Reset(const WorldMetadata &metadata) {
+    m_metadata = metadata;
+
+    for (auto &[pos, chunk] : m_chunks) {
+      m_dirty_chunks[pos] |= kAllSections;
+    }
+    m_chunks.Clear();
+    m_chunk_edits.clear();
+    m_pending_features.clear();
+    m_stored_features.clear();
+    m_has_stream_center = false;
+  }
+
+  struct ChunkLoad {
+    Chunk *chunk;
+    bool generated = false;
+    std::optional<ChunkEdits> edits;
+    // Blocks of features placed by this chunk that land in other chunks.
+    std::vector<FeatureBlock> features;
+    // Blocks of features placed in this chunk by chunks saved while it wasn't loaded, for worlds saved in full.
+    std::vector<BlockEdit> stored_features;
+  };
+
+  // A feature block waiting for its target chunk, see ApplyPendingFeatures().
+  struct PendingFeature {
+    ChunkPos source;
+    BlockEdit edit;
+  };
+
+  // Chunks saved in full are read back, everything else is generated, with its saved edits replayed on top. The map is
+  // only touched on this thread, the chunks themselves are filled in on the pool, one chunk per job.
+  void LoadChunkColumns() {
+    m_chunk_loads.clear();
+    for (auto [x, z] : m_columns_to_load) {
+      for (int y = 0; y < kWorldHeightInChunks; ++y) {
+        m_chunk_loads.push_back({&m_chunks.Insert({x, y, z})});
+      }
+    }
+
+    m_pool.ParallelFor(m_chunk_loads.size(), [this](size_t i, size_t) { LoadChunk(m_chunk_loads[i]); });
+
+    for (ChunkLoad &load : m_chunk_loads) {
+      ChunkPos pos = load.chunk->GetPos();
+      MarkChunkDirty(pos, kAllSections);
+      MarkNeighborsDirty(pos);
+
+      if (load.edits) {
+        m_chunk_edits[pos] = std::move(*load.edits);
+      }
+      // Saved on eviction, so the next load is a read.
+      if (m_storage && m_metadata.mode == PersistenceMode::Full && load.generated) {
+        m_unsaved_chunks.insert(pos);
+      }
+      // Saving the chunk clears the stored blocks once they're part of it.
+      if (!load.stored_features.empty()) {
+        m_unsaved_chunks.insert(pos);
+        m_stored_features.insert(pos);
+      }
+    }
+
+    // Features that crossed into other chunks are queued by target chunk. The new chunks pick up whatever was queued
+    // for them, and chunks that were already loaded get the blocks their new neighbors placed in them.
+    m_feature_targets.clear();
+    for (ChunkLoad &load : m_chunk_loads) {
+      ChunkPos source = load.chunk->GetPos();
+      m_feature_targets.insert(source);
+      // Their sources are saved already, the chunk stands in for them.
+      for (const BlockEdit &edit : load.stored_features) {
+        m_pending_features[source].push_back({source, edit});
+      }
+      for (const FeatureBlock &block : load.features) {
+        m_pending_features[block.target].push_back({source, block.edit});
+        m_feature_targets.insert(block.target);
+      }
+    }
+
+    for (ChunkPos target : m_feature_targets) {
+      ApplyPendingFeatures(target);
+    }
+  }
+
+  // Places the feature blocks queued for the chunk at `pos` where it's still air, and the block wasn't edited since.
+  // Chunks saved in full keep the blocks, so those are only applied once. Otherwise the chunk is generated again on its
+  // next load, so the blocks stay queued for as long as the chunk that placed them is loaded.
+  void ApplyPendingFeatures(ChunkPos pos) {
+    auto it = m_pending_features.find(pos);
+    Chunk *chunk = m_chunks.Find(pos);
+    if (it == m_pending_features.end() || !chunk) {
+      return;
+    }
+
+    auto edits = m_chunk_edits.find(pos);
+    bool changed = false;
+    for (const PendingFeature &feature : it->second) {
+      const BlockEdit &edit = feature.edit;
+      if (chunk->Get(edit.GetZ(), edit.GetX(), edit.GetY()) != BlockType::Air ||
+          (edits != m_chunk_edits.end() && edits->second.Contains(edit.index))) {
+        continue;
+      }
+
+      chunk->Set(edit.GetZ(), edit.GetX(), edit.GetY(), edit.type);
+      changed = true;
+    }
+
+    if (changed) {
+      MarkChunkDirty(pos, kAllSections);
+      MarkNeighborsDirty(pos);
+    }
+    if (m_metadata.mode == PersistenceMode::Full) {
+      if (changed && m_storage) {
+        m_unsaved_chunks.insert(pos);
+      }
+      m_pending_features.erase(it);
+    }
+  }
+
+  // Drops the queued blocks placed by the chunk at `source`, features never reach past the neighboring chunks. A chunk
+  // saved in full isn't generated again, so its blocks for chunks that aren't loaded are saved with the world first.
+  void DropPendingFeatures(ChunkPos source) {
+    static_assert(kMaxFeatureRadius < kMaxChunkWidth && kMaxFeatureRadius < kMaxChunkDepth);
+
+    for (int dy = -1; dy <= 1; ++dy) {
+      for (int dz = -1; dz <= 1; ++dz) {
+        for (int dx = -1; dx <= 1; ++dx) {
+          auto it = m_pending_features.find({source.x + dx, source.y + dy, source.z + dz});
+          if (it == m_pending_features.end()) {
+            continue;
+          }
+
+          if (m_storage && m_metadata.mode == PersistenceMode::Full && !m_chunks.Find(it->first)) {
+            SavePendingFeatures(it->first, source, it->second);
+          }
+          std::erase_if(it->second, [&](const PendingFeature &feature) { return feature.source == source; });
+          if (it->second.empty()) {
+            m_pending_features.erase(it);
+          }
+        }
+      }
+    }
+  }
+
+  // Adds the blocks placed by `source` to those stored for the chunk at `target`, a later block wins like it would
+  // have if the chunk was loaded.
+  void SavePendingFeatures(ChunkPos target, ChunkPos source, const std::vector<PendingFeature> &features) {
+    std::vector<BlockEdit> stored;
+    m_storage->LoadPendingFeatures(target, stored);
+
+    ChunkEdits edits{std::move(stored)};
+    for (const PendingFeature &feature : features) {
+      if (feature.source == source) {
+        const BlockEdit &edit = feature.edit;
+        edits.Record(edit.GetZ(), edit.GetX(), edit.GetY(), edit.type);
+      }
+    }
+    m_storage->SavePendingFeatures(target, edits.GetEdits());
+  }
+
+  // Runs on the pool, so it may only read the world's state.
+  void LoadChunk(ChunkLoad &load) const {
+    Chunk &chunk = *load.chunk;
+    ChunkPos pos = chunk.GetPos();
+
+    if (m_storage && m_metadata.mode == PersistenceMode::Full) {
+      m_storage->LoadPendingFeatures(pos, load.stored_features);
+      if (m_storage->LoadChunk(pos, chunk)) {
+        return;
+      }
+    }
+
+    m_generator.Generate(m_metadata.generator, pos, chunk, &load.features);
+    load.generated = true;
+
+    std::vector<BlockEdit> edits;
+    if (m_storage && m_metadata.mode == PersistenceMode::EditDeltas && m_storage->LoadChunkEdits(pos, edits)) {
+      load.edits.emplace(std::move(edits));
+      load.edits->Apply(chunk);
+    }
+  }
+
+  void SaveChunk(ChunkPos pos) {
+    Chunk *chunk = m_chunks.Find(pos);
+    if (!m_storage || !chunk) {
+      return;
+    }
+
+    if (m_metadata.mode == PersistenceMode::Full) {
+      if (m_storage->SaveChunk(pos, *chunk) && m_stored_features.erase(pos)) {
+        m_storage->SavePendingFeatures(pos, {});
+      }
+      DropPendingFeatures(pos);
+    } else if (auto it = m_chunk_edits.find(pos); it != m_chunk_edits.end()) {
+      m_storage->SaveChunkEdits(pos, it->second.GetEdits());
+    }
+  }
+
+  void EvictDistantChunks() {
+    int radius = m_streaming.unload_radius;
+
+    std::vector<ChunkPos> evicted;
+    for (auto &[pos, chunk] : m_chunks) {
+      int dx = pos.x - m_stream_center_x;
+      int dz = pos.z - m_stream_center_z;
+      if (dx * dx + dz * dz > radius * radius) {
+        evicted.push_back(pos);
+      }
+    }
+
+    for (ChunkPos pos : evicted) {
+      if (m_unsaved_chunks.erase(pos)) {
+        SaveChunk(pos);
+      }
+
+      m_chunks.Remove(pos);
+      MarkNeighborsDirty(pos);
+      m_chunk_edits.erase(pos);
+      DropPendingFeatures(pos);
+      m_dirty_chunks[pos] |= kAllSections;
+    }
+  }
+
+  static BlockPos ToLocal(BlockPos pos) {
+    return {FloorMod(pos.x, kMaxChunkWidth), FloorMod(pos.y, kMaxChunkHeight), FloorMod(pos.z, kMaxChunkDepth)};
+  }
 
 private:
-  std::vector<Chunk> m_chunks;
-  FastNoiseLite *m_noise;
+  ChunkMap m_chunks;
+  std::unordered_map<ChunkPos, uint32_t, ChunkPosHash> m_dirty_chunks;
+  WorldMetadata m_metadata;
+  ThreadPool m_pool;
+  // Filled from the pool, it locks internally.
+  mutable GenerationPipeline m_generator;
+
+  // Null for a world that isn't saved.
+  std::unique_ptr<RegionStorage> m_storage;
+  std::unordered_set<ChunkPos, ChunkPosHash> m_unsaved_chunks;
+  // Edits of the loaded chunks, only tracked for worlds saved as edit deltas.
+  std::unordered_map<ChunkPos, ChunkEdits, ChunkPosHash> m_chunk_edits;
+  // Feature blocks by the chunk they land in.
+  std::unordered_map<ChunkPos, std::vector<PendingFeature>, ChunkPosHash> m_pending_features;
+  // Loaded chunks that had feature blocks stored for them, cleared from the storage when the chunk is saved.
+  std::unordered_set<ChunkPos, ChunkPosHash> m_stored_features;
+  std::unordered_set<ChunkPos, ChunkPosHash> m_feature_targets;
+
+  StreamingSettings m_streaming;
+  // Column offsets within the load radius, nearest first.
+  std::vector<std::pair<int, int>> m_load_offsets;
+  std::vector<std::pair<int, int>> m_columns_to_load;
+  std::vector<ChunkLoad> m_chunk_loads;
+  bool m_has_stream_center = false;
+  bool m_stream_complete = false;
+  int m_stream_center_x = 0;
+  int m_stream_center_z = 0;
 };
 } // namespace craft